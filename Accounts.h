@@ -0,0 +1,228 @@
+#ifndef ACCOUNTS_H
+#define ACCOUNTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Order.h"
+
+// Self-trade prevention: what happens when an incoming order would match a
+// resting order of the same account. Cancel newest cancels the rest of the
+// incoming order and leaves the resting one; cancel oldest cancels the
+// resting order and goes on matching; decrement both takes the smaller
+// quantity off both orders without a trade. Cancelled quantity is reported
+// with the Cancel status.
+const int STP_NONE = 0;
+const int STP_CANCEL_NEWEST = 1;
+const int STP_CANCEL_OLDEST = 2;
+const int STP_DECREMENT_BOTH = 3;
+const int STP_MODE_COUNT = 4;
+
+inline const char *selfTradePreventionToString(int mode)
+{
+    switch (mode)
+    {
+    case STP_NONE:
+        return "none";
+    case STP_CANCEL_NEWEST:
+        return "cancel-newest";
+    case STP_CANCEL_OLDEST:
+        return "cancel-oldest";
+    case STP_DECREMENT_BOTH:
+        return "decrement-both";
+    default:
+        return "invalid";
+    }
+}
+
+// Returns STP_MODE_COUNT for a name that is not a mode.
+inline int stringToSelfTradePrevention(std::string_view mode)
+{
+    for (int i = 0; i < STP_MODE_COUNT; ++i)
+    {
+        if (mode == selfTradePreventionToString(i))
+            return i;
+    }
+    return STP_MODE_COUNT;
+}
+
+// Net position of one account in one instrument: quantity bought minus sold,
+// and the value bought minus sold in ticks times quantity.
+struct Position
+{
+    long long quantity = 0;
+    long long notional = 0;
+};
+
+// Accounts seen by one book, numbered from 1 in order of appearance (0 is
+// "no account"), and their positions. Names are found through an
+// open-addressing table kept at most a quarter full, so looking one up does
+// not allocate; only a new account does. A name is packed into a key of two
+// words and its length, so a lookup is a hash of the key and a few word
+// compares per probe, without touching the stored names. Positions are one
+// flat row of instrumentCount() entries per account, so a fill touches two
+// entries of a contiguous array.
+class AccountTable
+{
+private:
+    struct Slot
+    {
+        std::uint64_t low = 0;
+        std::uint64_t high = 0;
+        std::uint32_t length = 0;
+        std::int32_t account = 0;
+    };
+
+    std::vector<std::string> names;
+    std::vector<Slot> slots = std::vector<Slot>(16);
+    std::vector<Position> positions;
+    std::size_t instruments = static_cast<std::size_t>(instrumentCount());
+    Position untracked;
+
+    static std::uint64_t load(const char *bytes, int size)
+    {
+        std::uint64_t value = 0;
+        std::memcpy(&value, bytes, static_cast<std::size_t>(size));
+        return value;
+    }
+
+    // Packs the name into two words with fixed-size loads, overlapping for
+    // lengths between the load sizes; with the length this tells any two
+    // names of up to 16 bytes apart. Longer names keep their first and last
+    // 8 bytes and are told apart by their stored name.
+    static Slot keyOf(std::string_view name)
+    {
+        const char *bytes = name.data();
+        std::size_t size = name.size();
+        Slot key;
+        key.length = static_cast<std::uint32_t>(size);
+        if (size >= 8)
+        {
+            key.low = load(bytes, 8);
+            key.high = load(bytes + size - 8, 8);
+        }
+        else if (size >= 4)
+        {
+            key.low = load(bytes, 4) | load(bytes + size - 4, 4) << 32;
+        }
+        else if (size > 0)
+        {
+            key.low = load(bytes, 1) | load(bytes + size / 2, 1) << 8 | load(bytes + size - 1, 1) << 16;
+        }
+        return key;
+    }
+
+    std::size_t slotOf(const Slot &key, std::string_view name) const
+    {
+        // Names share their leading bytes ("acct1", "acct2"), so the key is
+        // folded before the multiply and the middle bits of the product taken.
+        std::uint64_t mixed = key.low ^ key.high * 0xC2B2AE3D27D4EB4Full;
+        mixed ^= mixed >> 32;
+        std::size_t mask = slots.size() - 1;
+        std::size_t slot = static_cast<std::size_t>((mixed * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        for (;; slot = (slot + 1) & mask)
+        {
+            const Slot &entry = slots[slot];
+            if (entry.account == 0)
+                return slot;
+            if (entry.low == key.low && entry.high == key.high && entry.length == key.length &&
+                (key.length <= 16 || names[entry.account - 1] == name))
+                return slot;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        for (const Slot &entry : old)
+        {
+            if (entry.account != 0)
+                slots[slotOf(entry, names[entry.account - 1])] = entry;
+        }
+    }
+
+public:
+    // Returns the account's number, or 0 if it has not been seen.
+    int find(std::string_view name) const
+    {
+        return slots[slotOf(keyOf(name), name)].account;
+    }
+
+    // Returns the account's number, adding the account if it is new. name
+    // must not be empty.
+    int intern(std::string_view name)
+    {
+        Slot key = keyOf(name);
+        std::size_t slot = slotOf(key, name);
+        if (slots[slot].account != 0)
+            return slots[slot].account;
+        names.emplace_back(name);
+        positions.resize(names.size() * instruments);
+        key.account = static_cast<int>(names.size());
+        slots[slot] = key;
+        if (names.size() * 4 > slots.size())
+            grow();
+        return key.account;
+    }
+
+    // Empty for account 0.
+    std::string_view name(int account) const
+    {
+        return account == 0 ? std::string_view() : std::string_view(names[account - 1]);
+    }
+
+    int size() const
+    {
+        return static_cast<int>(names.size());
+    }
+
+    // account must not be 0.
+    Position &position(int account, InstrumentType instrument)
+    {
+        return positions[(account - 1) * instruments + static_cast<std::size_t>(instrument)];
+    }
+
+    const Position &position(int account, InstrumentType instrument) const
+    {
+        return positions[(account - 1) * instruments + static_cast<std::size_t>(instrument)];
+    }
+
+    // Books a fill of quantity at price between a buying and a selling
+    // account; either may be 0, which is not tracked. Both sides are booked
+    // without branching, account 0 into a position nobody reads.
+    void recordFill(int buyer, int seller, InstrumentType instrument, long long price, int quantity)
+    {
+        long long value = price * quantity;
+        Position *column = positions.data() + static_cast<std::size_t>(instrument);
+        Position &bought = buyer != 0 ? column[(buyer - 1) * instruments] : untracked;
+        Position &sold = seller != 0 ? column[(seller - 1) * instruments] : untracked;
+        bought.quantity += quantity;
+        bought.notional += value;
+        sold.quantity -= quantity;
+        sold.notional -= value;
+    }
+
+    // Visits the position of every account in every instrument it has
+    // traded, account by account.
+    template <typename Visit>
+    void forEachPosition(Visit visit) const
+    {
+        for (int account = 1; account <= size(); ++account)
+        {
+            for (std::size_t i = 0; i < instruments; ++i)
+            {
+                InstrumentType instrument = static_cast<InstrumentType>(i);
+                const Position &held = position(account, instrument);
+                if (held.quantity != 0 || held.notional != 0)
+                    visit(account, instrument, held);
+            }
+        }
+    }
+};
+
+#endif
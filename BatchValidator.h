@@ -0,0 +1,372 @@
+#ifndef BATCH_VALIDATOR_H
+#define BATCH_VALIDATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "InstrumentUniverse.h"
+#include "Order.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FLOWER_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Validates orders a block at a time. The fields the rules look at are
+// copied into a structure-of-arrays block and every rule is evaluated for
+// all lanes at once, with AVX2 or SSE4.2 where the CPU has them and plain
+// branch-free C++ otherwise. The result is a reject mask with one bit per
+// order plus the reason code of every order, the same codes (and the same
+// rule order) as OrderBook::validateOrder. Order types are rare enough to be
+// handled outside the vector loops: market orders, which have no price to
+// check, and invalid types are kept as lane masks and fixed up around them,
+// as are instruments with a tick size and overlong account names, which are
+// rare as well. Every lane carries its own instrument's quantity, lot and
+// price band rules.
+
+const std::size_t VALIDATION_BLOCK_SIZE = 64;
+
+struct ValidationBlock
+{
+    alignas(32) std::int32_t idLength[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int32_t instrument[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int32_t side[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int32_t quantity[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int64_t price[VALIDATION_BLOCK_SIZE];
+    // Each lane's instrument rules, so a block may mix instruments with
+    // different rules; the lot size is kept as a LotTest.
+    alignas(32) std::int32_t minQuantity[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int32_t maxQuantity[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::uint32_t lotMask[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::uint32_t lotInverse[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::uint32_t lotLimit[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int64_t minTick[VALIDATION_BLOCK_SIZE];
+    alignas(32) std::int64_t maxTick[VALIDATION_BLOCK_SIZE];
+    std::uint64_t marketLanes = 0;
+    std::uint64_t invalidTypeLanes = 0;
+    // Lanes whose instrument has a tick size other than one tick.
+    std::uint64_t tickLanes = 0;
+    std::uint64_t invalidAccountLanes = 0;
+    std::size_t count = 0;
+
+    void clear()
+    {
+        count = 0;
+        marketLanes = 0;
+        invalidTypeLanes = 0;
+        tickLanes = 0;
+        invalidAccountLanes = 0;
+    }
+
+    bool full() const
+    {
+        return count == VALIDATION_BLOCK_SIZE;
+    }
+
+    void add(const Order &order)
+    {
+        static const InstrumentRules unlistedRules;
+        static const LotTest unlistedLot;
+
+        std::size_t i = count++;
+        idLength[i] = static_cast<std::int32_t>(order.clientOrderId.size() < 0x7FFFFFFF ? order.clientOrderId.size() : 0x7FFFFFFF);
+        instrument[i] = static_cast<std::int32_t>(order.instrument);
+        side[i] = order.side;
+        quantity[i] = order.quantity;
+        price[i] = order.price;
+
+        const InstrumentUniverse &universe = instrumentUniverse();
+        bool listed = static_cast<std::uint32_t>(order.instrument) < static_cast<std::uint32_t>(universe.size());
+        const InstrumentRules &rules = listed ? universe.rules(order.instrument) : unlistedRules;
+        const LotTest &lot = listed ? universe.lotTest(order.instrument) : unlistedLot;
+        minQuantity[i] = rules.minQuantity;
+        maxQuantity[i] = rules.maxQuantity;
+        lotMask[i] = lot.lowMask;
+        lotInverse[i] = lot.inverse;
+        lotLimit[i] = lot.limit;
+        minTick[i] = rules.band.minTick;
+        maxTick[i] = rules.band.maxTick;
+        tickLanes |= static_cast<std::uint64_t>(rules.tickSize != 1) << i;
+        invalidAccountLanes |= static_cast<std::uint64_t>(order.account.size() > ACCOUNT_CAPACITY) << i;
+
+        if (order.type != ORDER_LIMIT)
+        {
+            marketLanes |= static_cast<std::uint64_t>(order.type == ORDER_MARKET) << i;
+            invalidTypeLanes |= static_cast<std::uint64_t>(static_cast<unsigned>(order.type) >=
+                                                           static_cast<unsigned>(ORDER_TYPE_COUNT)) << i;
+        }
+    }
+
+    // Gives unused lanes harmless values so the vector loops can always run
+    // over whole blocks.
+    void pad()
+    {
+        for (std::size_t i = count; i < VALIDATION_BLOCK_SIZE; ++i)
+        {
+            idLength[i] = 0;
+            instrument[i] = 0;
+            side[i] = 0;
+            quantity[i] = 0;
+            price[i] = 0;
+            minQuantity[i] = 0;
+            maxQuantity[i] = 0;
+            lotMask[i] = 0;
+            lotInverse[i] = 1;
+            lotLimit[i] = 0xFFFFFFFFu;
+            minTick[i] = 0;
+            maxTick[i] = 0;
+        }
+    }
+};
+
+struct ValidationResult
+{
+    // Bit i is set if order i of the block is rejected.
+    std::uint64_t rejectMask = 0;
+    alignas(32) std::int32_t reasons[VALIDATION_BLOCK_SIZE];
+};
+
+// instrumentCount is the number of listed instruments.
+typedef void (*BlockValidatorFunction)(const ValidationBlock &, std::int32_t instrumentCount, ValidationResult &);
+
+inline void validateBlockScalar(const ValidationBlock &block, std::int32_t instrumentCount, ValidationResult &result)
+{
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < VALIDATION_BLOCK_SIZE; ++i)
+    {
+        std::int32_t quantity = block.quantity[i];
+        std::uint32_t lots = static_cast<std::uint32_t>(quantity);
+        bool badQuantity = (quantity < block.minQuantity[i]) | (quantity > block.maxQuantity[i]) |
+                           ((lots & block.lotMask[i]) != 0) | (lots * block.lotInverse[i] > block.lotLimit[i]);
+        bool badPrice = (block.price[i] < block.minTick[i]) | (block.price[i] > block.maxTick[i]);
+        bool badSide = (block.side[i] != 1) & (block.side[i] != 2);
+        bool badInstrument = static_cast<std::uint32_t>(block.instrument[i]) >= static_cast<std::uint32_t>(instrumentCount);
+        bool badId = static_cast<std::uint32_t>(block.idLength[i] - 1) > 6u;
+
+        std::int32_t reason = badQuantity ? 5 : 0;
+        reason = badPrice ? 4 : reason;
+        reason = badSide ? 3 : reason;
+        reason = badInstrument ? 2 : reason;
+        reason = badId ? 1 : reason;
+        result.reasons[i] = reason;
+        mask |= static_cast<std::uint64_t>(reason != 0) << i;
+    }
+    result.rejectMask = mask;
+}
+
+#ifdef FLOWER_HAVE_X86_SIMD
+
+// Lot sizes are checked with LotTest's multiply-and-compare. Unsigned
+// comparisons are done as signed ones after flipping the top bit.
+
+__attribute__((target("avx2"))) inline void validateBlockAvx2(const ValidationBlock &block, std::int32_t instrumentCount,
+                                                               ValidationResult &result)
+{
+    const __m256i flip = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i lastInstrument = _mm256_xor_si256(_mm256_set1_epi32(instrumentCount - 1), flip);
+
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < VALIDATION_BLOCK_SIZE; i += 8)
+    {
+        __m256i quantity = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.quantity + i));
+        __m256i minQuantity = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.minQuantity + i));
+        __m256i maxQuantity = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.maxQuantity + i));
+        __m256i badQuantity = _mm256_or_si256(_mm256_cmpgt_epi32(minQuantity, quantity),
+                                              _mm256_cmpgt_epi32(quantity, maxQuantity));
+        __m256i lotMask = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.lotMask + i));
+        __m256i lotInverse = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.lotInverse + i));
+        __m256i lotLimit = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.lotLimit + i));
+        __m256i lowBits = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(quantity, lotMask), zero),
+                                           _mm256_set1_epi32(-1));
+        __m256i lots = _mm256_xor_si256(_mm256_mullo_epi32(quantity, lotInverse), flip);
+        __m256i notLots = _mm256_cmpgt_epi32(lots, _mm256_xor_si256(lotLimit, flip));
+        badQuantity = _mm256_or_si256(badQuantity, _mm256_or_si256(lowBits, notLots));
+
+        __m256i lowPrices = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.price + i));
+        __m256i highPrices = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.price + i + 4));
+        __m256i lowMin = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.minTick + i));
+        __m256i highMin = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.minTick + i + 4));
+        __m256i lowMax = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.maxTick + i));
+        __m256i highMax = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.maxTick + i + 4));
+        __m256i badLow = _mm256_or_si256(_mm256_cmpgt_epi64(lowMin, lowPrices), _mm256_cmpgt_epi64(lowPrices, lowMax));
+        __m256i badHigh = _mm256_or_si256(_mm256_cmpgt_epi64(highMin, highPrices), _mm256_cmpgt_epi64(highPrices, highMax));
+        int priceBits = _mm256_movemask_pd(_mm256_castsi256_pd(badLow)) |
+                        (_mm256_movemask_pd(_mm256_castsi256_pd(badHigh)) << 4);
+        __m256i badPrice = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(priceBits), laneBits), laneBits);
+
+        __m256i side = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.side + i));
+        __m256i badSide = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(side, _mm256_set1_epi32(1)),
+                                                              _mm256_cmpeq_epi32(side, _mm256_set1_epi32(2))),
+                                              _mm256_set1_epi32(-1));
+
+        __m256i instrument = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.instrument + i));
+        __m256i badInstrument = _mm256_cmpgt_epi32(_mm256_xor_si256(instrument, flip), lastInstrument);
+
+        __m256i idLength = _mm256_load_si256(reinterpret_cast<const __m256i *>(block.idLength + i));
+        __m256i badId = _mm256_cmpgt_epi32(_mm256_xor_si256(_mm256_sub_epi32(idLength, _mm256_set1_epi32(1)), flip),
+                                           _mm256_xor_si256(_mm256_set1_epi32(6), flip));
+
+        __m256i reason = _mm256_and_si256(badQuantity, _mm256_set1_epi32(5));
+        reason = _mm256_blendv_epi8(reason, _mm256_set1_epi32(4), badPrice);
+        reason = _mm256_blendv_epi8(reason, _mm256_set1_epi32(3), badSide);
+        reason = _mm256_blendv_epi8(reason, _mm256_set1_epi32(2), badInstrument);
+        reason = _mm256_blendv_epi8(reason, _mm256_set1_epi32(1), badId);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(result.reasons + i), reason);
+
+        __m256i rejected = _mm256_xor_si256(_mm256_cmpeq_epi32(reason, zero), _mm256_set1_epi32(-1));
+        mask |= static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(rejected))) << i;
+    }
+    result.rejectMask = mask;
+}
+
+__attribute__((target("sse4.2"))) inline void validateBlockSse42(const ValidationBlock &block, std::int32_t instrumentCount,
+                                                                  ValidationResult &result)
+{
+    const __m128i flip = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128i lastInstrument = _mm_xor_si128(_mm_set1_epi32(instrumentCount - 1), flip);
+
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < VALIDATION_BLOCK_SIZE; i += 4)
+    {
+        __m128i quantity = _mm_load_si128(reinterpret_cast<const __m128i *>(block.quantity + i));
+        __m128i minQuantity = _mm_load_si128(reinterpret_cast<const __m128i *>(block.minQuantity + i));
+        __m128i maxQuantity = _mm_load_si128(reinterpret_cast<const __m128i *>(block.maxQuantity + i));
+        __m128i badQuantity = _mm_or_si128(_mm_cmplt_epi32(quantity, minQuantity), _mm_cmpgt_epi32(quantity, maxQuantity));
+        __m128i lotMask = _mm_load_si128(reinterpret_cast<const __m128i *>(block.lotMask + i));
+        __m128i lotInverse = _mm_load_si128(reinterpret_cast<const __m128i *>(block.lotInverse + i));
+        __m128i lotLimit = _mm_load_si128(reinterpret_cast<const __m128i *>(block.lotLimit + i));
+        __m128i lowBits = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(quantity, lotMask), zero), _mm_set1_epi32(-1));
+        __m128i lots = _mm_xor_si128(_mm_mullo_epi32(quantity, lotInverse), flip);
+        __m128i notLots = _mm_cmpgt_epi32(lots, _mm_xor_si128(lotLimit, flip));
+        badQuantity = _mm_or_si128(badQuantity, _mm_or_si128(lowBits, notLots));
+
+        __m128i lowPrices = _mm_load_si128(reinterpret_cast<const __m128i *>(block.price + i));
+        __m128i highPrices = _mm_load_si128(reinterpret_cast<const __m128i *>(block.price + i + 2));
+        __m128i lowMin = _mm_load_si128(reinterpret_cast<const __m128i *>(block.minTick + i));
+        __m128i highMin = _mm_load_si128(reinterpret_cast<const __m128i *>(block.minTick + i + 2));
+        __m128i lowMax = _mm_load_si128(reinterpret_cast<const __m128i *>(block.maxTick + i));
+        __m128i highMax = _mm_load_si128(reinterpret_cast<const __m128i *>(block.maxTick + i + 2));
+        __m128i badLow = _mm_or_si128(_mm_cmpgt_epi64(lowMin, lowPrices), _mm_cmpgt_epi64(lowPrices, lowMax));
+        __m128i badHigh = _mm_or_si128(_mm_cmpgt_epi64(highMin, highPrices), _mm_cmpgt_epi64(highPrices, highMax));
+        int priceBits = _mm_movemask_pd(_mm_castsi128_pd(badLow)) | (_mm_movemask_pd(_mm_castsi128_pd(badHigh)) << 2);
+        __m128i badPrice = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(priceBits), laneBits), laneBits);
+
+        __m128i side = _mm_load_si128(reinterpret_cast<const __m128i *>(block.side + i));
+        __m128i badSide = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(side, _mm_set1_epi32(1)),
+                                                        _mm_cmpeq_epi32(side, _mm_set1_epi32(2))),
+                                           _mm_set1_epi32(-1));
+
+        __m128i instrument = _mm_load_si128(reinterpret_cast<const __m128i *>(block.instrument + i));
+        __m128i badInstrument = _mm_cmpgt_epi32(_mm_xor_si128(instrument, flip), lastInstrument);
+
+        __m128i idLength = _mm_load_si128(reinterpret_cast<const __m128i *>(block.idLength + i));
+        __m128i badId = _mm_cmpgt_epi32(_mm_xor_si128(_mm_sub_epi32(idLength, _mm_set1_epi32(1)), flip),
+                                        _mm_xor_si128(_mm_set1_epi32(6), flip));
+
+        __m128i reason = _mm_and_si128(badQuantity, _mm_set1_epi32(5));
+        reason = _mm_blendv_epi8(reason, _mm_set1_epi32(4), badPrice);
+        reason = _mm_blendv_epi8(reason, _mm_set1_epi32(3), badSide);
+        reason = _mm_blendv_epi8(reason, _mm_set1_epi32(2), badInstrument);
+        reason = _mm_blendv_epi8(reason, _mm_set1_epi32(1), badId);
+        _mm_store_si128(reinterpret_cast<__m128i *>(result.reasons + i), reason);
+
+        __m128i rejected = _mm_xor_si128(_mm_cmpeq_epi32(reason, zero), _mm_set1_epi32(-1));
+        mask |= static_cast<std::uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(rejected))) << i;
+    }
+    result.rejectMask = mask;
+}
+
+#endif
+
+// Picks a block validator by name ("avx2", "sse4.2" or "scalar"), or the
+// fastest one the CPU supports for "auto". Returns nullptr for a name this
+// CPU or build cannot run.
+inline BlockValidatorFunction selectBlockValidator(std::string_view name = "auto")
+{
+#ifdef FLOWER_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (name == "avx2" || (name == "auto" && avx2))
+        return avx2 ? validateBlockAvx2 : nullptr;
+    if (name == "sse4.2" || (name == "auto" && sse42))
+        return sse42 ? validateBlockSse42 : nullptr;
+#endif
+    if (name == "scalar" || name == "auto")
+        return validateBlockScalar;
+    return nullptr;
+}
+
+class BatchValidator
+{
+private:
+    BlockValidatorFunction validate;
+
+public:
+    explicit BatchValidator(BlockValidatorFunction validate = selectBlockValidator()) : validate(validate)
+    {
+    }
+
+    // Validates the block's orders; lanes past block.count are never
+    // rejected.
+    void run(ValidationBlock &block, ValidationResult &result) const
+    {
+        block.pad();
+        if (block.marketLanes != 0)
+        {
+            for (std::size_t i = 0; i < block.count; ++i)
+            {
+                if (block.marketLanes >> i & 1)
+                    block.price[i] = block.minTick[i];
+            }
+        }
+        validate(block, instrumentCount(), result);
+        if (block.count < VALIDATION_BLOCK_SIZE)
+            result.rejectMask &= (std::uint64_t(1) << block.count) - 1;
+        // A price off its instrument's tick grid is an invalid price, which
+        // ranks after the client order ID, instrument and side.
+        std::uint64_t tickLanes = block.tickLanes & ~block.marketLanes;
+        if (tickLanes != 0)
+        {
+            for (std::size_t i = 0; i < block.count; ++i)
+            {
+                if ((tickLanes >> i & 1) && (result.reasons[i] == 0 || result.reasons[i] == 5) &&
+                    !rulesFor(static_cast<InstrumentType>(block.instrument[i])).validPrice(block.price[i]))
+                {
+                    result.reasons[i] = 4;
+                    result.rejectMask |= std::uint64_t(1) << i;
+                }
+            }
+        }
+        if (block.invalidTypeLanes != 0)
+        {
+            for (std::size_t i = 0; i < block.count; ++i)
+            {
+                if ((block.invalidTypeLanes >> i & 1) && result.reasons[i] == 0)
+                {
+                    result.reasons[i] = 6;
+                    result.rejectMask |= std::uint64_t(1) << i;
+                }
+            }
+        }
+        if (block.invalidAccountLanes != 0)
+        {
+            for (std::size_t i = 0; i < block.count; ++i)
+            {
+                if ((block.invalidAccountLanes >> i & 1) && result.reasons[i] == 0)
+                {
+                    result.reasons[i] = 7;
+                    result.rejectMask |= std::uint64_t(1) << i;
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,366 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "Accounts.h"
+#include "BatchValidator.h"
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderGenerator.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+
+using namespace std;
+
+// Measures each stage of the engine on its own against a seeded synthetic
+// order flow: parsing orders.csv text, validating (order by order and in
+// SIMD blocks), matching and writing the execution reports. Every stage runs
+// twice, once untimed per item for throughput and once with a timestamp
+// around every item for latency percentiles. Results are printed and
+// written as JSON for diffing across versions. With --accounts the orders
+// carry accounts, so the match stage also books positions and, with --stp,
+// checks for self-trades. Generating accounts changes the whole order flow,
+// so their cost is measured apart, against the same orders without them.
+
+typedef chrono::steady_clock Clock;
+
+struct StageResult
+{
+    string name;
+    size_t items = 0;
+    double seconds = 0;
+    vector<uint32_t> latencies;
+
+    double percentile(double fraction) const
+    {
+        if (latencies.empty())
+            return 0;
+        size_t index = static_cast<size_t>(fraction * (latencies.size() - 1) + 0.5);
+        return latencies[index];
+    }
+};
+
+// Report sink that keeps the reports of the match stage for the write stage.
+struct CaptureOutput
+{
+    vector<StoredReport> reports;
+};
+
+void writeExecutionReport(const ExecutionReport &report, CaptureOutput &output)
+{
+    output.reports.emplace_back();
+    output.reports.back().store(report);
+}
+
+// Report sink that only counts, for timing matching without keeping reports.
+struct CountOutput
+{
+    size_t reports = 0;
+};
+
+void writeExecutionReport(const ExecutionReport &, CountOutput &output)
+{
+    ++output.reports;
+}
+
+template <typename Step>
+StageResult runStage(const string &name, size_t items, Step step)
+{
+    StageResult result;
+    result.name = name;
+    result.items = items;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < items; ++i)
+        step(i, false);
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    result.latencies.resize(items);
+    for (size_t i = 0; i < items; ++i)
+    {
+        Clock::time_point before = Clock::now();
+        step(i, true);
+        long long nanos = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - before).count();
+        result.latencies[i] = static_cast<uint32_t>(min<long long>(nanos, UINT32_MAX));
+    }
+    sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+// Returns how much longer matching the orders takes with their accounts
+// than without, as a fraction: the median over rounds on fresh books, each
+// alternating chunks of the two runs of the one order flow so both see the
+// same machine state. Accounts are resolved before timing, as in the match
+// stage.
+double accountOverhead(const vector<Order> &orders, int selfTradePrevention, int rounds)
+{
+    const size_t chunk = 20000;
+    vector<Order> anonymous = orders;
+    for (Order &order : anonymous)
+        order.account = string_view();
+
+    vector<double> ratios;
+    for (int round = 0; round < rounds; ++round)
+    {
+        OrderBook withAccounts;
+        OrderBook withoutAccounts;
+        withAccounts.setSelfTradePrevention(selfTradePrevention);
+        withoutAccounts.setSelfTradePrevention(selfTradePrevention);
+        vector<int> accountIds(orders.size());
+        for (size_t i = 0; i < orders.size(); ++i)
+            accountIds[i] = withAccounts.accountIdFor(orders[i].account);
+
+        CountOutput output;
+        double seconds[2] = {0, 0};
+        for (size_t start = 0; start < orders.size(); start += chunk)
+        {
+            size_t end = min(orders.size(), start + chunk);
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                bool accounts = (pass + round) % 2 == 1;
+                Clock::time_point before = Clock::now();
+                for (size_t i = start; i < end; ++i)
+                {
+                    Order order = accounts ? orders[i] : anonymous[i];
+                    order.orderId = static_cast<int>(i + 1);
+                    if (accounts)
+                    {
+                        order.accountId = accountIds[i];
+                        withAccounts.processNumberedOrder(order, output);
+                    }
+                    else
+                    {
+                        withoutAccounts.processNumberedOrder(order, output);
+                    }
+                }
+                seconds[accounts] += chrono::duration<double>(Clock::now() - before).count();
+            }
+        }
+        ratios.push_back(seconds[1] / seconds[0] - 1);
+    }
+    sort(ratios.begin(), ratios.end());
+    return ratios[ratios.size() / 2];
+}
+
+void printResult(const StageResult &result)
+{
+    double rate = result.seconds > 0 ? result.items / result.seconds : 0;
+    cout << result.name << ": " << result.items << " items in " << result.seconds * 1000 << " ms, "
+         << static_cast<long long>(rate) << " items/s, latency ns p50 " << result.percentile(0.5)
+         << " p90 " << result.percentile(0.9) << " p99 " << result.percentile(0.99)
+         << " p99.9 " << result.percentile(0.999) << " max " << result.percentile(1.0) << endl;
+}
+
+void writeJson(const string &path, const GeneratorConfig &config, int selfTradePrevention,
+               const vector<StageResult> &results, double overhead)
+{
+    ofstream json(path);
+    json << "{\n  \"config\": {\"orders\": " << config.orders << ", \"seed\": " << config.seed << ", \"mix\": [";
+    for (size_t i = 0; i < config.instrumentWeights.size(); ++i)
+        json << (i ? ", " : "") << config.instrumentWeights[i];
+    json << "], \"aggressive\": " << config.aggressiveRatio << ", \"invalid\": " << config.invalidRate
+         << ", \"step\": " << config.priceStep << ", \"depth\": " << config.priceDepth
+         << ", \"accounts\": " << config.accounts << ", \"stp\": \""
+         << selfTradePreventionToString(selfTradePrevention) << "\"},\n  \"stages\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const StageResult &result = results[i];
+        double rate = result.seconds > 0 ? result.items / result.seconds : 0;
+        json << "    {\"name\": \"" << result.name << "\", \"items\": " << result.items
+             << ", \"seconds\": " << result.seconds << ", \"items_per_second\": " << static_cast<long long>(rate)
+             << ", \"latency_ns\": {\"p50\": " << result.percentile(0.5) << ", \"p90\": " << result.percentile(0.9)
+             << ", \"p99\": " << result.percentile(0.99) << ", \"p999\": " << result.percentile(0.999)
+             << ", \"max\": " << result.percentile(1.0) << "}}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]";
+    if (config.accounts > 0)
+        json << ",\n  \"account_overhead\": " << overhead;
+    json << "\n}\n";
+}
+
+bool parseWeights(const string &text, vector<double> &weights)
+{
+    weights.clear();
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == string::npos)
+            end = text.size();
+        weights.push_back(atof(text.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+    return weights.size() == static_cast<size_t>(instrumentCount());
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorConfig config;
+    int selfTradePrevention = STP_NONE;
+    string ordersPath = "bench_orders.csv";
+    string outputPath = "bench_execution_rep.csv";
+    string jsonPath = "bench_result.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--orders" && i + 1 < argc)
+            config.orders = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--mix" && i + 1 < argc && parseWeights(argv[i + 1], config.instrumentWeights))
+            ++i;
+        else if (arg == "--aggressive" && i + 1 < argc)
+            config.aggressiveRatio = atof(argv[++i]);
+        else if (arg == "--invalid" && i + 1 < argc)
+            config.invalidRate = atof(argv[++i]);
+        else if (arg == "--step" && i + 1 < argc)
+            config.priceStep = atoll(argv[++i]);
+        else if (arg == "--depth" && i + 1 < argc)
+            config.priceDepth = atoll(argv[++i]);
+        else if (arg == "--accounts" && i + 1 < argc)
+            config.accounts = atoi(argv[++i]);
+        else if (arg == "--stp" && i + 1 < argc && stringToSelfTradePrevention(argv[i + 1]) != STP_MODE_COUNT)
+            selfTradePrevention = stringToSelfTradePrevention(argv[++i]);
+        else if (arg == "--orders-file" && i + 1 < argc)
+            ordersPath = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--orders N] [--seed N] [--mix W,W,W,W,W] [--aggressive RATIO]"
+                 << " [--invalid RATIO] [--step TICKS] [--depth TICKS] [--accounts N]"
+                 << " [--stp none|cancel-newest|cancel-oldest|decrement-both] [--orders-file FILE] [--output FILE]"
+                 << " [--json FILE]" << endl;
+            return 1;
+        }
+    }
+
+    {
+        ReportWriter ordersFile(ordersPath.c_str());
+        ordersFile.append("Cl. Ord. ID,Instrument,Side,Price,Quantity");
+        if (config.accounts > 0)
+            ordersFile.append(",Type,Account");
+        ordersFile.endRecord();
+        OrderGenerator generator(config);
+        while (generator.next(ordersFile))
+        {
+        }
+    }
+
+    MappedFile input;
+    if (!input.open(ordersPath.c_str()))
+    {
+        cerr << "Error: Could not open " << ordersPath << endl;
+        return 1;
+    }
+
+    vector<Order> orders;
+    orders.reserve(config.orders);
+    {
+        CsvOrderReader reader(input.contents());
+        Order order;
+        while (reader.next(order))
+            orders.push_back(order);
+    }
+
+    vector<StageResult> results;
+
+    vector<size_t> rowStarts;
+    {
+        string_view text = input.contents();
+        size_t position = text.find('\n');
+        while (position != string_view::npos && position + 1 < text.size())
+        {
+            rowStarts.push_back(position + 1);
+            position = text.find('\n', position + 1);
+        }
+    }
+    size_t parsed = 0;
+    results.push_back(runStage("parse", rowStarts.size(), [&](size_t i, bool)
+                               {
+        string_view text = input.contents();
+        size_t end = text.find('\n', rowStarts[i]);
+        if (end == string_view::npos)
+            end = text.size();
+        Order order;
+        parsed += parseOrderLine(text.substr(rowStarts[i], end - rowStarts[i]), order); }));
+
+    OrderBook validator;
+    int rejects = 0;
+    results.push_back(runStage("validate", orders.size(), [&](size_t i, bool)
+                               { rejects += validator.validateOrder(orders[i]) != 0; }));
+
+    // Same rules a block of orders at a time; items are blocks here.
+    vector<ValidationBlock> blocks((orders.size() + VALIDATION_BLOCK_SIZE - 1) / VALIDATION_BLOCK_SIZE);
+    for (size_t i = 0; i < orders.size(); ++i)
+        blocks[i / VALIDATION_BLOCK_SIZE].add(orders[i]);
+    BatchValidator batchValidator;
+    size_t batchRejects = 0;
+    results.push_back(runStage("validate-blocks", blocks.size(), [&](size_t i, bool)
+                               {
+        ValidationResult result;
+        batchValidator.run(blocks[i], result);
+        batchRejects += bitset<64>(result.rejectMask).count(); }));
+
+    CaptureOutput scratch;
+    CaptureOutput captured;
+    scratch.reports.reserve(orders.size() * 3);
+    captured.reports.reserve(orders.size() * 3);
+    OrderBook throughputBook;
+    OrderBook latencyBook;
+    throughputBook.setSelfTradePrevention(selfTradePrevention);
+    latencyBook.setSelfTradePrevention(selfTradePrevention);
+    // Orders come from client sessions that resolved their account once, as
+    // a server connection does, so the books are not timed looking up the
+    // account name of every order.
+    vector<int> throughputAccounts(orders.size());
+    vector<int> latencyAccounts(orders.size());
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        throughputAccounts[i] = throughputBook.accountIdFor(orders[i].account);
+        latencyAccounts[i] = latencyBook.accountIdFor(orders[i].account);
+    }
+    results.push_back(runStage("match", orders.size(), [&](size_t i, bool timed)
+                               {
+        Order order = orders[i];
+        order.orderId = static_cast<int>(i + 1);
+        order.accountId = timed ? latencyAccounts[i] : throughputAccounts[i];
+        if (timed)
+            latencyBook.processNumberedOrder(order, captured);
+        else
+            throughputBook.processNumberedOrder(order, scratch); }));
+
+    // Each pass writes the whole file again, so --output ends up holding the
+    // reports exactly once.
+    unique_ptr<ReportWriter> output;
+    results.push_back(runStage("write", captured.reports.size(), [&](size_t i, bool)
+                               {
+        if (i == 0)
+            output = make_unique<ReportWriter>(outputPath.c_str());
+        writeExecutionReport(captured.reports[i].get(), *output); }));
+    output.reset();
+
+    double overhead = config.accounts > 0 ? accountOverhead(orders, selfTradePrevention, 5) : 0;
+
+    if (batchRejects != static_cast<size_t>(rejects))
+        cerr << "Warning: Block validation rejected " << batchRejects / 2 << " orders" << endl;
+    cout << "Orders: " << parsed / 2 << " parsed, " << rejects / 2 << " rejected, "
+         << captured.reports.size() << " execution reports" << endl;
+    for (const StageResult &result : results)
+        printResult(result);
+    if (config.accounts > 0)
+        cout << "Account overhead in match: " << overhead * 100
+             << "% (median of 5 runs against the same orders without accounts)" << endl;
+    writeJson(jsonPath, config, selfTradePrevention, results, overhead);
+    return 0;
+}
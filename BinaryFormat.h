@@ -0,0 +1,275 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Order.h"
+#include "ReportWriter.h"
+
+// Fixed-width little-endian files for orders and execution reports, so replay
+// runs can skip CSV parsing and formatting. Every file starts with a header:
+//
+//   offset  size  field
+//        0     4  magic, "FXOB" for orders or "FXER" for reports
+//        4     2  format version
+//        6     2  record size in bytes
+//        8     2  number of instruments in the dictionary
+//       10     2  reserved
+//       12  16*n  instrument names, NUL padded, in code order
+//
+// followed by the records. Instrument fields in records are indexes into the
+// file's dictionary, or 0xFFFF for an instrument that failed to parse. Client
+// order IDs and accounts are stored NUL padded in 16 bytes; longer ones are
+// truncated (they are rejected as invalid either way).
+//
+// Order record (56 bytes):        Report record (40 bytes):
+//    0  16  client order ID          0  16  client order ID
+//   16   8  price in ticks          16   8  price in ticks
+//   24   4  quantity                24   4  order ID
+//   28   4  side                    28   4  quantity
+//   32   2  instrument              32   4  side
+//   34   1  order type              36   2  instrument
+//   35   5  reserved                38   1  status
+//   40  16  account, NUL padded     39   1  reject reason
+//
+// Files of any other format version or record size are not read.
+
+const char ORDER_FILE_MAGIC[4] = {'F', 'X', 'O', 'B'};
+const char REPORT_FILE_MAGIC[4] = {'F', 'X', 'E', 'R'};
+const std::uint16_t BINARY_FORMAT_VERSION = 2;
+const std::size_t BINARY_HEADER_SIZE = 12;
+const std::size_t BINARY_NAME_SIZE = INSTRUMENT_NAME_CAPACITY;
+const std::size_t BINARY_ID_SIZE = 16;
+const std::size_t BINARY_ORDER_SIZE = 56;
+const std::size_t BINARY_REPORT_SIZE = 40;
+const std::uint16_t BINARY_INVALID_INSTRUMENT = 0xFFFF;
+
+inline void storeLittleEndian(char *out, std::uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+inline std::uint64_t loadLittleEndian(const char *in, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+inline void storeClientOrderId(char *out, std::string_view clientOrderId)
+{
+    std::memset(out, 0, BINARY_ID_SIZE);
+    std::memcpy(out, clientOrderId.data(), std::min(clientOrderId.size(), BINARY_ID_SIZE));
+}
+
+inline std::string_view loadClientOrderId(const char *in)
+{
+    std::size_t length = 0;
+    while (length < BINARY_ID_SIZE && in[length] != '\0')
+        ++length;
+    return std::string_view(in, length);
+}
+
+inline std::uint16_t instrumentCode(InstrumentType instrument)
+{
+    return instrument == InstrumentType::Invalid ? BINARY_INVALID_INSTRUMENT : static_cast<std::uint16_t>(instrument);
+}
+
+inline void writeBinaryHeader(ReportWriter &output, const char magic[4], std::size_t recordSize)
+{
+    char header[BINARY_HEADER_SIZE];
+    std::memcpy(header, magic, 4);
+    storeLittleEndian(header + 4, BINARY_FORMAT_VERSION, 2);
+    storeLittleEndian(header + 6, recordSize, 2);
+    storeLittleEndian(header + 8, static_cast<std::uint64_t>(instrumentCount()), 2);
+    storeLittleEndian(header + 10, 0, 2);
+    output.append(std::string_view(header, sizeof(header)));
+
+    for (int i = 0; i < instrumentCount(); ++i)
+    {
+        char name[BINARY_NAME_SIZE] = {};
+        std::string_view text = instrumentToString(static_cast<InstrumentType>(i));
+        std::memcpy(name, text.data(), std::min(text.size(), BINARY_NAME_SIZE));
+        output.append(std::string_view(name, sizeof(name)));
+    }
+}
+
+inline bool hasBinaryMagic(std::string_view data, const char magic[4])
+{
+    return data.size() >= 4 && std::memcmp(data.data(), magic, 4) == 0;
+}
+
+// Walks the records of a binary file that is already in memory, mapping the
+// file's instrument dictionary onto InstrumentType.
+class BinaryRecordReader
+{
+private:
+    std::string_view data;
+    std::size_t position = 0;
+    std::size_t recordSize = 0;
+    std::vector<InstrumentType> instruments;
+
+public:
+    // Returns false if data is not a file of the current format version with
+    // the given magic and records of expectedRecordSize bytes.
+    bool open(std::string_view contents, const char magic[4], std::size_t expectedRecordSize)
+    {
+        if (contents.size() < BINARY_HEADER_SIZE || !hasBinaryMagic(contents, magic))
+            return false;
+        std::uint64_t version = loadLittleEndian(contents.data() + 4, 2);
+        if (version != BINARY_FORMAT_VERSION)
+            return false;
+
+        recordSize = loadLittleEndian(contents.data() + 6, 2);
+        std::size_t instrumentCount = loadLittleEndian(contents.data() + 8, 2);
+        std::size_t dataOffset = BINARY_HEADER_SIZE + instrumentCount * BINARY_NAME_SIZE;
+        if (recordSize != expectedRecordSize || contents.size() < dataOffset)
+            return false;
+
+        instruments.clear();
+        for (std::size_t i = 0; i < instrumentCount; ++i)
+        {
+            const char *name = contents.data() + BINARY_HEADER_SIZE + i * BINARY_NAME_SIZE;
+            std::size_t length = 0;
+            while (length < BINARY_NAME_SIZE && name[length] != '\0')
+                ++length;
+            instruments.push_back(stringToInstrument(std::string_view(name, length)));
+        }
+
+        data = contents;
+        position = dataOffset;
+        return true;
+    }
+
+    // Returns the next whole record, or nullptr at the end of the file.
+    const char *next()
+    {
+        if (recordSize == 0 || data.size() - position < recordSize)
+            return nullptr;
+        const char *record = data.data() + position;
+        position += recordSize;
+        return record;
+    }
+
+    // Reads the instrument field at field.
+    InstrumentType instrument(const char *field) const
+    {
+        std::size_t code = loadLittleEndian(field, 2);
+        return code < instruments.size() ? instruments[code] : InstrumentType::Invalid;
+    }
+};
+
+inline void writeBinaryOrder(const Order &order, ReportWriter &output)
+{
+    char record[BINARY_ORDER_SIZE] = {};
+    storeClientOrderId(record, order.clientOrderId);
+    storeLittleEndian(record + 16, static_cast<std::uint64_t>(order.price), 8);
+    storeLittleEndian(record + 24, static_cast<std::uint32_t>(order.quantity), 4);
+    storeLittleEndian(record + 28, static_cast<std::uint32_t>(order.side), 4);
+    storeLittleEndian(record + 32, instrumentCode(order.instrument), 2);
+    record[34] = static_cast<char>(order.type);
+    storeClientOrderId(record + 40, order.account);
+    output.append(std::string_view(record, sizeof(record)));
+}
+
+// Reads orders from a binary order file; same interface as CsvOrderReader.
+class BinaryOrderReader
+{
+private:
+    BinaryRecordReader records;
+
+public:
+    bool open(std::string_view contents)
+    {
+        return records.open(contents, ORDER_FILE_MAGIC, BINARY_ORDER_SIZE);
+    }
+
+    bool next(Order &order)
+    {
+        const char *record = records.next();
+        if (record == nullptr)
+            return false;
+
+        order.clientOrderId = loadClientOrderId(record);
+        order.price = static_cast<long long>(loadLittleEndian(record + 16, 8));
+        order.quantity = static_cast<std::int32_t>(loadLittleEndian(record + 24, 4));
+        order.side = static_cast<std::int32_t>(loadLittleEndian(record + 28, 4));
+        order.instrument = records.instrument(record + 32);
+        order.type = static_cast<unsigned char>(record[34]);
+        order.account = loadClientOrderId(record + 40);
+        order.accountId = 0;
+        return true;
+    }
+};
+
+// Report sink that writes binary report records instead of CSV lines.
+class BinaryReportWriter
+{
+private:
+    ReportWriter &output;
+
+public:
+    explicit BinaryReportWriter(ReportWriter &output) : output(output)
+    {
+        writeBinaryHeader(output, REPORT_FILE_MAGIC, BINARY_REPORT_SIZE);
+    }
+
+    void write(const ExecutionReport &report)
+    {
+        char record[BINARY_REPORT_SIZE] = {};
+        storeClientOrderId(record, report.clientOrderId);
+        storeLittleEndian(record + 16, static_cast<std::uint64_t>(report.price), 8);
+        storeLittleEndian(record + 24, static_cast<std::uint32_t>(report.orderId), 4);
+        storeLittleEndian(record + 28, static_cast<std::uint32_t>(report.quantity), 4);
+        storeLittleEndian(record + 32, static_cast<std::uint32_t>(report.side), 4);
+        storeLittleEndian(record + 36, instrumentCode(report.instrument), 2);
+        record[38] = static_cast<char>(report.status);
+        record[39] = static_cast<char>(report.reason);
+        output.append(std::string_view(record, sizeof(record)));
+        output.endBinaryRecord();
+    }
+};
+
+inline void writeExecutionReport(const ExecutionReport &report, BinaryReportWriter &output)
+{
+    output.write(report);
+}
+
+class BinaryReportReader
+{
+private:
+    BinaryRecordReader records;
+
+public:
+    bool open(std::string_view contents)
+    {
+        return records.open(contents, REPORT_FILE_MAGIC, BINARY_REPORT_SIZE);
+    }
+
+    bool next(ExecutionReport &report)
+    {
+        const char *record = records.next();
+        if (record == nullptr)
+            return false;
+
+        report.clientOrderId = loadClientOrderId(record);
+        report.price = static_cast<long long>(loadLittleEndian(record + 16, 8));
+        report.orderId = static_cast<std::int32_t>(loadLittleEndian(record + 24, 4));
+        report.quantity = static_cast<std::int32_t>(loadLittleEndian(record + 28, 4));
+        report.side = static_cast<std::int32_t>(loadLittleEndian(record + 32, 4));
+        report.instrument = records.instrument(record + 36);
+        report.status = static_cast<unsigned char>(record[38]);
+        report.reason = static_cast<unsigned char>(record[39]);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef INSTRUMENT_UNIVERSE_H
+#define INSTRUMENT_UNIVERSE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Prices are carried as integer ticks of 0.01 from parsing to reporting, so
+// matching never compares floating-point values.
+const long long TICKS_PER_UNIT = 100;
+const int PRICE_DECIMALS = 2;
+
+// Longest instrument name; binary files store names in this many bytes.
+const std::size_t INSTRUMENT_NAME_CAPACITY = 16;
+
+// An instrument is its index in the instrument universe; Invalid stands for
+// a name that is not listed.
+enum class InstrumentType : std::int32_t
+{
+    Invalid = -1
+};
+
+// Range of prices, in ticks, that a book accepts. Every ladder allocates one
+// level per tick in the band up front.
+struct PriceBand
+{
+    long long minTick = 1;
+    long long maxTick = 1000 * TICKS_PER_UNIT;
+
+    bool contains(long long price) const
+    {
+        return price >= minTick && price <= maxTick;
+    }
+};
+
+// Trading rules of an instrument: prices must be inside band and a multiple
+// of tickSize ticks, and quantities a multiple of lotSize between
+// minQuantity and maxQuantity.
+struct InstrumentRules
+{
+    long long tickSize = 1;
+    int lotSize = 10;
+    int minQuantity = 10;
+    int maxQuantity = 1000;
+    PriceBand band;
+
+    bool validPrice(long long price) const
+    {
+        return band.contains(price) && price % tickSize == 0;
+    }
+
+    bool validQuantity(int quantity) const
+    {
+        return quantity >= minQuantity && quantity <= maxQuantity && quantity % lotSize == 0;
+    }
+};
+
+// Divisibility by a lot size without dividing, for the vector validators: q
+// is a multiple of lot = m * 2^k (m odd) if its low k bits are zero and
+// q * inverse, with inverse the inverse of m modulo 2^32, is at most
+// limit = (2^32 - 1) / m as an unsigned value.
+struct LotTest
+{
+    std::uint32_t lowMask = 0;
+    std::uint32_t inverse = 1;
+    std::uint32_t limit = 0xFFFFFFFFu;
+
+    explicit LotTest(int lotSize = 1)
+    {
+        std::uint32_t odd = static_cast<std::uint32_t>(lotSize);
+        while (odd != 0 && (odd & 1) == 0)
+        {
+            odd >>= 1;
+            lowMask = (lowMask << 1) | 1;
+        }
+        if (odd == 0)
+            return;
+        // Newton's iteration doubles the correct low bits of the inverse.
+        inverse = odd;
+        for (int i = 0; i < 5; ++i)
+            inverse *= 2 - odd * inverse;
+        limit = 0xFFFFFFFFu / odd;
+    }
+
+    bool divides(int quantity) const
+    {
+        std::uint32_t value = static_cast<std::uint32_t>(quantity);
+        return (value & lowMask) == 0 && value * inverse <= limit;
+    }
+};
+
+// The listed instruments and their rules. Names resolve through a perfect
+// hash built when the universe is finished: each name hashes to a bucket,
+// and each bucket has a seed picked so that its names land in distinct free
+// slots of a table at most half full, so a lookup is two hashes and one
+// comparison.
+class InstrumentUniverse
+{
+private:
+    std::vector<std::string> names;
+    std::vector<InstrumentRules> instrumentRules;
+    std::vector<LotTest> lotTests;
+    std::vector<std::uint32_t> bucketSeeds;
+    std::vector<std::int32_t> slots;
+
+    static std::uint32_t hashName(std::string_view name, std::uint32_t seed)
+    {
+        std::uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (char c : name)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        hash ^= hash >> 15;
+        hash *= 0x2C1B3C6Du;
+        hash ^= hash >> 12;
+        return hash;
+    }
+
+    // Tries to place every bucket with a table of slotCount slots.
+    bool buildHash(std::size_t slotCount)
+    {
+        std::size_t bucketCount = bucketSeeds.size();
+        std::vector<std::vector<std::int32_t>> buckets(bucketCount);
+        for (std::size_t id = 0; id < names.size(); ++id)
+            buckets[hashName(names[id], 0) % bucketCount].push_back(static_cast<std::int32_t>(id));
+
+        std::vector<std::size_t> order(bucketCount);
+        for (std::size_t i = 0; i < bucketCount; ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t a, std::size_t b)
+                         { return buckets[a].size() > buckets[b].size(); });
+
+        slots.assign(slotCount, -1);
+        std::vector<std::uint32_t> placed;
+        for (std::size_t bucket : order)
+        {
+            if (buckets[bucket].empty())
+                break;
+            std::uint32_t seed = 1;
+            for (;; ++seed)
+            {
+                if (seed > 1000000)
+                    return false;
+                placed.clear();
+                bool fits = true;
+                for (std::int32_t id : buckets[bucket])
+                {
+                    std::uint32_t slot = hashName(names[id], seed) & (slotCount - 1);
+                    if (slots[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end())
+                    {
+                        fits = false;
+                        break;
+                    }
+                    placed.push_back(slot);
+                }
+                if (fits)
+                    break;
+            }
+            bucketSeeds[bucket] = seed;
+            for (std::size_t i = 0; i < placed.size(); ++i)
+                slots[placed[i]] = buckets[bucket][i];
+        }
+        return true;
+    }
+
+public:
+    // The five flowers of the original exchange with the default rules.
+    static InstrumentUniverse flowers()
+    {
+        InstrumentUniverse universe;
+        for (const char *name : {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"})
+            universe.add(name, InstrumentRules());
+        universe.finish();
+        return universe;
+    }
+
+    // Lists an instrument; returns false if the name is empty, too long,
+    // "Invalid" or already listed, or if there are too many instruments for
+    // the binary formats. finish must be called before names are looked up.
+    bool add(std::string_view name, const InstrumentRules &rules)
+    {
+        if (name.empty() || name.size() > INSTRUMENT_NAME_CAPACITY || name == "Invalid" || names.size() >= 0xFFFF ||
+            std::find(names.begin(), names.end(), name) != names.end())
+            return false;
+        names.emplace_back(name);
+        instrumentRules.push_back(rules);
+        lotTests.emplace_back(rules.lotSize);
+        return true;
+    }
+
+    void finish()
+    {
+        std::size_t slotCount = 1;
+        while (slotCount < 2 * names.size())
+            slotCount <<= 1;
+        for (;; slotCount <<= 1)
+        {
+            bucketSeeds.assign(std::max<std::size_t>(names.size(), 1), 0);
+            if (buildHash(slotCount))
+                return;
+        }
+    }
+
+    // Applies one price band to every instrument.
+    void setPriceBand(const PriceBand &band)
+    {
+        for (InstrumentRules &rules : instrumentRules)
+            rules.band = band;
+    }
+
+    int size() const
+    {
+        return static_cast<int>(names.size());
+    }
+
+    InstrumentType find(std::string_view name) const
+    {
+        if (slots.empty())
+            return InstrumentType::Invalid;
+        std::uint32_t seed = bucketSeeds[hashName(name, 0) % bucketSeeds.size()];
+        std::int32_t id = slots[hashName(name, seed) & (slots.size() - 1)];
+        return id >= 0 && names[id] == name ? static_cast<InstrumentType>(id) : InstrumentType::Invalid;
+    }
+
+    // "Invalid" for an instrument that is not listed.
+    std::string_view name(InstrumentType instrument) const
+    {
+        std::size_t id = static_cast<std::size_t>(instrument);
+        return id < names.size() ? std::string_view(names[id]) : std::string_view("Invalid");
+    }
+
+    // instrument must be listed.
+    const InstrumentRules &rules(InstrumentType instrument) const
+    {
+        return instrumentRules[static_cast<std::size_t>(instrument)];
+    }
+
+    const LotTest &lotTest(InstrumentType instrument) const
+    {
+        return lotTests[static_cast<std::size_t>(instrument)];
+    }
+};
+
+// The universe every book, parser and report uses. It is the five flowers
+// unless main loads another one at startup; it must not change once books
+// exist.
+inline InstrumentUniverse &instrumentUniverse()
+{
+    static InstrumentUniverse universe = InstrumentUniverse::flowers();
+    return universe;
+}
+
+#endif
@@ -0,0 +1,364 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "BinaryFormat.h"
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+
+// Write-ahead journal and book snapshots, so a restarted engine picks up the
+// books and the order ID sequence where the previous run left them.
+//
+// Both files use the binary file header from BinaryFormat.h (magic "FXJL"
+// for the journal, "FXSN" for snapshots) followed by 56-byte records:
+//
+//    0  16  client order ID
+//   16   8  price in ticks
+//   24   4  quantity
+//   28   1  side
+//   29   1  record type
+//   30   1  status, for fills
+//   31   1  order type
+//   32   2  instrument
+//   34   2  reserved
+//   36   4  order ID
+//   40  16  account, NUL padded
+//
+// The journal holds, in processing order, every accepted order ('O') before
+// it is matched, the ID of every rejected order ('R'), and every fill report
+// ('F'). A snapshot holds the order ID sequence ('S'), the last trade price
+// of every instrument that traded ('T'), every account's position in each
+// instrument ('P', with the net quantity in bytes 0-7 and the notional in the
+// price field), the orders that count towards each account's order rate
+// limit ('W', oldest first, with the account and order ID), every resting
+// order and pending stop order ('B') in queue order, and the fills so far of
+// each resting order that has any ('E', with the filled quantity and the
+// filled notional in the price field). A checkpoint writes a new snapshot
+// next to the old one, renames it into place and then starts an empty
+// journal; on startup the snapshot is loaded and the accepted orders in the
+// journal are matched again, skipping any the snapshot already covers.
+// Orders rejected by a risk limit or by a call auction passed the field
+// checks, so they are journaled as accepted and rejected again on replay.
+// Rejected orders still move the session on, so an auction they close is
+// uncrossed on replay as well.
+//
+// Journal records are handed to the operating system every flushRecords
+// records, which survives the process crashing but not the machine losing
+// power; a torn last record is ignored on restore.
+
+const char JOURNAL_FILE_MAGIC[4] = {'F', 'X', 'J', 'L'};
+const char SNAPSHOT_FILE_MAGIC[4] = {'F', 'X', 'S', 'N'};
+const std::size_t JOURNAL_RECORD_SIZE = 56;
+
+const char JOURNAL_ACCEPTED = 'O';
+const char JOURNAL_REJECTED = 'R';
+const char JOURNAL_FILL = 'F';
+const char JOURNAL_SEQUENCE = 'S';
+const char JOURNAL_RESTING = 'B';
+const char JOURNAL_LAST_TRADE = 'T';
+const char JOURNAL_POSITION = 'P';
+const char JOURNAL_RECENT_ORDER = 'W';
+const char JOURNAL_RESTING_FILLS = 'E';
+
+inline void writeJournalRecord(ReportWriter &output, char type, std::string_view clientOrderId, InstrumentType instrument,
+                               int side, long long price, int quantity, int orderId, int status = 0,
+                               int orderType = ORDER_LIMIT, std::string_view account = std::string_view())
+{
+    char record[JOURNAL_RECORD_SIZE] = {};
+    storeClientOrderId(record, clientOrderId);
+    storeLittleEndian(record + 16, static_cast<std::uint64_t>(price), 8);
+    storeLittleEndian(record + 24, static_cast<std::uint32_t>(quantity), 4);
+    record[28] = static_cast<char>(side);
+    record[29] = type;
+    record[30] = static_cast<char>(status);
+    record[31] = static_cast<char>(orderType);
+    storeLittleEndian(record + 32, instrumentCode(instrument), 2);
+    storeLittleEndian(record + 36, static_cast<std::uint32_t>(orderId), 4);
+    storeClientOrderId(record + 40, account);
+    output.append(std::string_view(record, sizeof(record)));
+}
+
+inline void writePositionRecord(ReportWriter &output, std::string_view account, InstrumentType instrument,
+                                const Position &position)
+{
+    char record[JOURNAL_RECORD_SIZE] = {};
+    storeLittleEndian(record, static_cast<std::uint64_t>(position.quantity), 8);
+    storeLittleEndian(record + 16, static_cast<std::uint64_t>(position.notional), 8);
+    record[29] = JOURNAL_POSITION;
+    storeLittleEndian(record + 32, instrumentCode(instrument), 2);
+    storeClientOrderId(record + 40, account);
+    output.append(std::string_view(record, sizeof(record)));
+}
+
+// Reads a journal or snapshot record into an order; returns the record type.
+inline char readJournalRecord(const BinaryRecordReader &records, const char *record, Order &order)
+{
+    order.clientOrderId = loadClientOrderId(record);
+    order.price = static_cast<long long>(loadLittleEndian(record + 16, 8));
+    order.quantity = static_cast<std::int32_t>(loadLittleEndian(record + 24, 4));
+    order.orderId = static_cast<std::int32_t>(loadLittleEndian(record + 36, 4));
+    order.instrument = records.instrument(record + 32);
+    order.account = loadClientOrderId(record + 40);
+    order.accountId = 0;
+    order.side = static_cast<unsigned char>(record[28]);
+    order.type = static_cast<unsigned char>(record[31]);
+    return record[29];
+}
+
+struct RestoreStats
+{
+    std::size_t snapshotOrders = 0;
+    std::size_t journalOrders = 0;
+    std::size_t journalFills = 0;
+    std::size_t replayedFills = 0;
+};
+
+// Report sink for replaying the journal: reports were already written by
+// the run that journaled the orders, so only fills are counted.
+struct ReplayOutput
+{
+    std::size_t fills = 0;
+};
+
+inline void writeExecutionReport(const ExecutionReport &report, ReplayOutput &output)
+{
+    if (report.status == 2 || report.status == 3)
+        ++output.fills;
+}
+
+class Journal
+{
+private:
+    std::string journalPath;
+    std::string snapshotPath;
+    std::size_t flushRecords;
+    std::unique_ptr<ReportWriter> output;
+
+    bool loadSnapshot(OrderBook &orderBook, RestoreStats &stats, int &sequence)
+    {
+        MappedFile file;
+        if (!file.open(snapshotPath.c_str()))
+            return true;
+        BinaryRecordReader records;
+        if (!records.open(file.contents(), SNAPSHOT_FILE_MAGIC, JOURNAL_RECORD_SIZE))
+            return false;
+
+        Order order;
+        const char *record;
+        while ((record = records.next()) != nullptr)
+        {
+            char type = readJournalRecord(records, record, order);
+            if (type == JOURNAL_SEQUENCE)
+            {
+                sequence = order.orderId;
+                // A snapshot taken in a call phase holds the collected,
+                // crossed book; the auction picks up from there.
+                ReplayOutput replay;
+                orderBook.advanceSession(sequence, replay);
+            }
+            else if (type == JOURNAL_LAST_TRADE)
+            {
+                orderBook.restoreLastTradePrice(order.instrument, order.price);
+            }
+            else if (type == JOURNAL_POSITION)
+            {
+                Position position;
+                position.quantity = static_cast<long long>(loadLittleEndian(record, 8));
+                position.notional = order.price;
+                orderBook.restorePosition(order.account, order.instrument, position);
+            }
+            else if (type == JOURNAL_RECENT_ORDER)
+            {
+                orderBook.restoreRecentOrder(order.account, order.orderId);
+            }
+            else if (type == JOURNAL_RESTING)
+            {
+                if (!orderBook.restoreOrder(order))
+                    return false;
+                ++stats.snapshotOrders;
+            }
+            else if (type == JOURNAL_RESTING_FILLS)
+            {
+                if (!orderBook.restoreFills(order.orderId, order.quantity, order.price))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool replayJournal(OrderBook &orderBook, RestoreStats &stats, int &sequence)
+    {
+        MappedFile file;
+        if (!file.open(journalPath.c_str()))
+            return true;
+        BinaryRecordReader records;
+        if (!records.open(file.contents(), JOURNAL_FILE_MAGIC, JOURNAL_RECORD_SIZE))
+            return false;
+
+        int snapshotSequence = sequence;
+        bool covered = false;
+        ReplayOutput replay;
+        Order order;
+        const char *record;
+        while ((record = records.next()) != nullptr)
+        {
+            // Fills belong to the order journaled before them, and a fill's
+            // order ID may be that of an older resting order.
+            char type = readJournalRecord(records, record, order);
+            if (type == JOURNAL_ACCEPTED || type == JOURNAL_REJECTED)
+                covered = order.orderId <= snapshotSequence;
+            if (covered)
+                continue;
+            if (type == JOURNAL_ACCEPTED)
+            {
+                orderBook.processNumberedOrder(order, replay);
+                ++stats.journalOrders;
+            }
+            else if (type == JOURNAL_FILL)
+            {
+                ++stats.journalFills;
+                continue;
+            }
+            else if (type == JOURNAL_REJECTED)
+            {
+                orderBook.advanceSession(order.orderId, replay);
+            }
+            else
+            {
+                continue;
+            }
+            if (order.orderId > sequence)
+                sequence = order.orderId;
+        }
+        stats.replayedFills = replay.fills;
+        return true;
+    }
+
+    void startJournal()
+    {
+        output = std::make_unique<ReportWriter>(journalPath.c_str(), ReportWriter::DEFAULT_BUFFER_SIZE, flushRecords);
+        writeBinaryHeader(*output, JOURNAL_FILE_MAGIC, JOURNAL_RECORD_SIZE);
+        output->flush();
+    }
+
+public:
+    Journal(const std::string &journalPath, const std::string &snapshotPath, std::size_t flushRecords)
+        : journalPath(journalPath), snapshotPath(snapshotPath), flushRecords(flushRecords)
+    {
+    }
+
+    // Rebuilds the books and the order ID sequence from the snapshot and the
+    // journal, if they exist. Returns false if either file is unreadable or
+    // does not fit the book's price band; the books are then incomplete and
+    // should not be used.
+    bool restore(OrderBook &orderBook, RestoreStats &stats)
+    {
+        int sequence = 0;
+        if (!loadSnapshot(orderBook, stats, sequence) || !replayJournal(orderBook, stats, sequence))
+            return false;
+        orderBook.resumeOrderIds(sequence);
+        return true;
+    }
+
+    // Writes a snapshot of the books and starts a new, empty journal.
+    // Returns false if the snapshot could not be written in full; the old
+    // snapshot and the current journal are then kept.
+    bool checkpoint(const OrderBook &orderBook)
+    {
+        std::string temporaryPath = snapshotPath + ".tmp";
+        {
+            ReportWriter snapshot(temporaryPath.c_str());
+            if (!snapshot.is_open())
+                return false;
+            writeBinaryHeader(snapshot, SNAPSHOT_FILE_MAGIC, JOURNAL_RECORD_SIZE);
+            writeJournalRecord(snapshot, JOURNAL_SEQUENCE, std::string_view(), InstrumentType::Invalid, 0, 0, 0,
+                               orderBook.lastAssignedOrderId());
+            for (int i = 0; i < instrumentCount(); ++i)
+            {
+                InstrumentType instrument = static_cast<InstrumentType>(i);
+                long long price = orderBook.lastTradePrice(instrument);
+                if (price != 0)
+                    writeJournalRecord(snapshot, JOURNAL_LAST_TRADE, std::string_view(), instrument, 0, price, 0, 0);
+            }
+            const AccountTable &accounts = orderBook.accountTable();
+            accounts.forEachPosition([&](int account, InstrumentType instrument, const Position &position)
+                                     { writePositionRecord(snapshot, accounts.name(account), instrument, position); });
+            for (int account = 1; account <= accounts.size(); ++account)
+            {
+                orderBook.accountRisk().forEachRecentOrder(account, [&](int orderId)
+                                                           { writeJournalRecord(snapshot, JOURNAL_RECENT_ORDER,
+                                                                                std::string_view(), InstrumentType::Invalid,
+                                                                                0, 0, 0, orderId, 0, ORDER_LIMIT,
+                                                                                accounts.name(account)); });
+            }
+            orderBook.forEachRestingOrder([&](const RestingOrder &resting)
+                                          { writeJournalRecord(snapshot, JOURNAL_RESTING, resting.clientOrderId.view(),
+                                                               resting.instrument, resting.side, resting.price,
+                                                               resting.quantity, resting.orderId, 0, ORDER_LIMIT,
+                                                               accounts.name(resting.account)); });
+            orderBook.forEachStopOrder([&](const RestingOrder &stop)
+                                       { writeJournalRecord(snapshot, JOURNAL_RESTING, stop.clientOrderId.view(),
+                                                            stop.instrument, stop.side, stop.price, stop.quantity,
+                                                            stop.orderId, 0, ORDER_STOP, accounts.name(stop.account)); });
+            orderBook.forEachRestingOrder([&](const RestingOrder &resting)
+                                          {
+                OrderState state;
+                if (resting.filledQuantity != 0 && orderBook.findOrder(resting.orderId, state))
+                    writeJournalRecord(snapshot, JOURNAL_RESTING_FILLS, std::string_view(), resting.instrument, 0,
+                                       state.filledNotional, state.filledQuantity, resting.orderId); });
+            snapshot.close();
+            if (!snapshot.good())
+            {
+                std::remove(temporaryPath.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temporaryPath.c_str(), snapshotPath.c_str()) != 0)
+            return false;
+        startJournal();
+        return output->is_open();
+    }
+
+    void recordOrder(const Order &order, int reason)
+    {
+        if (reason != 0)
+            writeJournalRecord(*output, JOURNAL_REJECTED, std::string_view(), InstrumentType::Invalid, 0, 0, 0, order.orderId);
+        else
+            writeJournalRecord(*output, JOURNAL_ACCEPTED, order.clientOrderId, order.instrument, order.side, order.price,
+                               order.quantity, order.orderId, 0, order.type, order.account);
+        output->endBinaryRecord();
+    }
+
+    void recordFill(const ExecutionReport &report)
+    {
+        writeJournalRecord(*output, JOURNAL_FILL, report.clientOrderId, report.instrument, report.side, report.price,
+                           report.quantity, report.orderId, report.status);
+        output->endBinaryRecord();
+    }
+};
+
+// Report sink that journals fills on their way to the real output.
+template <typename Output>
+struct JournaledOutput
+{
+    Journal &journal;
+    Output &output;
+};
+
+template <typename Output>
+void writeExecutionReport(const ExecutionReport &report, JournaledOutput<Output> &output)
+{
+    if (report.status == 2 || report.status == 3)
+        output.journal.recordFill(report);
+    writeExecutionReport(report, output.output);
+}
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+// Per-order latency instrumentation for OrderBook. Only a build with
+// -DFLOWER_LATENCY_STATS records anything; otherwise LatencyRecorder is an
+// empty class whose calls compile away entirely.
+
+#include "Order.h"
+
+#ifdef FLOWER_LATENCY_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define FLOWER_HAVE_TSC
+#endif
+
+// Timestamps in nanoseconds. On x86-64 these come from the TSC, scaled by a
+// rate measured against steady_clock the first time it is needed.
+class LatencyClock
+{
+public:
+    static std::uint64_t ticks()
+    {
+#ifdef FLOWER_HAVE_TSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    static double nanosPerTick()
+    {
+#ifdef FLOWER_HAVE_TSC
+        static const double rate = []()
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::uint64_t startTicks = __rdtsc();
+            while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10))
+            {
+            }
+            std::uint64_t endTicks = __rdtsc();
+            double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            return endTicks > startTicks ? nanos / (endTicks - startTicks) : 1.0;
+        }();
+        return rate;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+// HDR-style log-linear histogram over a fixed array: values below 64 get
+// their own bucket, and every power of two above that is split into 32
+// buckets, so any recorded value is reported within about 3%.
+class LatencyHistogram
+{
+private:
+    static const int SUB_BUCKETS = 32;
+    static const int MAX_EXPONENT = 40;
+    static const int BUCKETS = 2 * SUB_BUCKETS + (MAX_EXPONENT - 5) * SUB_BUCKETS;
+
+    std::uint64_t counts[BUCKETS] = {};
+    std::uint64_t total = 0;
+    std::uint64_t maximum = 0;
+
+    static int bucketOf(std::uint64_t value)
+    {
+        if (value < 2 * SUB_BUCKETS)
+            return static_cast<int>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        if (exponent > MAX_EXPONENT)
+            return BUCKETS - 1;
+        int shift = exponent - 5;
+        return 2 * SUB_BUCKETS + (exponent - 6) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+    }
+
+    // Middle of a bucket's value range.
+    static std::uint64_t valueOf(int bucket)
+    {
+        if (bucket < 2 * SUB_BUCKETS)
+            return bucket;
+        int exponent = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 6;
+        int shift = exponent - 5;
+        std::uint64_t mantissa = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+        return (mantissa << shift) + (std::uint64_t(1) << shift) / 2;
+    }
+
+public:
+    void record(std::uint64_t value)
+    {
+        ++counts[bucketOf(value)];
+        ++total;
+        maximum = std::max(maximum, value);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < BUCKETS; ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    std::uint64_t count() const
+    {
+        return total;
+    }
+
+    std::uint64_t max() const
+    {
+        return maximum;
+    }
+
+    std::uint64_t percentile(double fraction) const
+    {
+        std::uint64_t target = static_cast<std::uint64_t>(fraction * total + 0.5);
+        if (target == 0)
+            target = 1;
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += counts[i];
+            if (seen >= target)
+                return std::min(valueOf(i), maximum);
+        }
+        return maximum;
+    }
+};
+
+const int LATENCY_STAGES = 5;
+const int LATENCY_OUTCOMES = STATUS_COUNT;
+
+inline const char *latencyStageName(int stage)
+{
+    static const char *const names[LATENCY_STAGES] = {"validate", "book lookup", "matching", "report emission", "total"};
+    return names[stage];
+}
+
+// Histograms for every stage and incoming order outcome, which uses the
+// execution status codes.
+struct InstrumentLatency
+{
+    LatencyHistogram histograms[LATENCY_STAGES][LATENCY_OUTCOMES];
+};
+
+// Latency by instrument, with Invalid after the listed instruments. An
+// instrument's histograms are allocated when it first records, so a large
+// universe only pays for what trades.
+struct LatencyStats
+{
+    std::vector<std::unique_ptr<InstrumentLatency>> instruments;
+
+    static std::size_t indexOf(InstrumentType instrument)
+    {
+        return instrument == InstrumentType::Invalid ? static_cast<std::size_t>(instrumentCount())
+                                                     : static_cast<std::size_t>(instrument);
+    }
+
+    InstrumentLatency &forIndex(std::size_t index)
+    {
+        if (index >= instruments.size())
+            instruments.resize(index + 1);
+        if (!instruments[index])
+            instruments[index] = std::make_unique<InstrumentLatency>();
+        return *instruments[index];
+    }
+
+    void merge(const LatencyStats &other)
+    {
+        for (std::size_t index = 0; index < other.instruments.size(); ++index)
+        {
+            if (!other.instruments[index])
+                continue;
+            InstrumentLatency &latency = forIndex(index);
+            for (int stage = 0; stage < LATENCY_STAGES; ++stage)
+                for (int outcome = 0; outcome < LATENCY_OUTCOMES; ++outcome)
+                    latency.histograms[stage][outcome].merge(other.instruments[index]->histograms[stage][outcome]);
+        }
+    }
+
+    void print(std::ostream &output) const
+    {
+        output << "Latency (ns): stage, instrument, outcome, count, p50, p90, p99, p99.9, max" << '\n';
+        for (int stage = 0; stage < LATENCY_STAGES; ++stage)
+        {
+            for (std::size_t index = 0; index < instruments.size(); ++index)
+            {
+                if (!instruments[index])
+                    continue;
+                for (int outcome = 0; outcome < LATENCY_OUTCOMES; ++outcome)
+                {
+                    const LatencyHistogram &histogram = instruments[index]->histograms[stage][outcome];
+                    if (histogram.count() == 0)
+                        continue;
+                    output << latencyStageName(stage) << ", "
+                           << instrumentToString(static_cast<InstrumentType>(index)) << ", "
+                           << statusToString(outcome) << ", " << histogram.count() << ", "
+                           << histogram.percentile(0.5) << ", " << histogram.percentile(0.9) << ", "
+                           << histogram.percentile(0.99) << ", " << histogram.percentile(0.999) << ", "
+                           << histogram.max() << '\n';
+                }
+            }
+        }
+    }
+};
+
+// Stats of every OrderBook that has been destroyed so far, for the summary
+// printed at exit.
+inline std::mutex latencyStatsMutex;
+inline LatencyStats latencyStatsTotal;
+
+inline void printLatencyStats(std::ostream &output)
+{
+    std::lock_guard<std::mutex> lock(latencyStatsMutex);
+    latencyStatsTotal.print(output);
+}
+
+// Timestamps one order's way through OrderBook::processNumberedOrder. Time
+// spent writing reports is taken out of the stage it happened in and
+// counted as report emission.
+class LatencyRecorder
+{
+private:
+    std::unique_ptr<LatencyStats> stats = std::make_unique<LatencyStats>();
+    std::uint64_t started = 0;
+    std::uint64_t lastMark = 0;
+    std::uint64_t stageTicks[LATENCY_STAGES] = {};
+    std::uint64_t emitStarted = 0;
+    std::uint64_t emitTicks = 0;
+    int stage = 0;
+
+    void mark(int nextStage)
+    {
+        std::uint64_t now = LatencyClock::ticks();
+        stageTicks[stage] += now - lastMark - emitTicks;
+        stageTicks[3] += emitTicks;
+        emitTicks = 0;
+        lastMark = now;
+        stage = nextStage;
+    }
+
+public:
+    LatencyRecorder() = default;
+    LatencyRecorder(LatencyRecorder &&) = default;
+
+    ~LatencyRecorder()
+    {
+        if (!stats)
+            return;
+        std::lock_guard<std::mutex> lock(latencyStatsMutex);
+        latencyStatsTotal.merge(*stats);
+    }
+
+    void begin()
+    {
+        started = lastMark = LatencyClock::ticks();
+        for (int i = 0; i < LATENCY_STAGES; ++i)
+            stageTicks[i] = 0;
+        emitTicks = 0;
+        stage = 0;
+    }
+
+    void validated()
+    {
+        mark(1);
+    }
+
+    void lookedUp()
+    {
+        mark(2);
+    }
+
+    void beginEmit()
+    {
+        emitStarted = LatencyClock::ticks();
+    }
+
+    void endEmit()
+    {
+        emitTicks += LatencyClock::ticks() - emitStarted;
+    }
+
+    void finish(InstrumentType instrument, int outcome)
+    {
+        mark(stage);
+        stageTicks[4] = lastMark - started;
+
+        double nanosPerTick = LatencyClock::nanosPerTick();
+        InstrumentLatency &latency = stats->forIndex(LatencyStats::indexOf(instrument));
+        bool rejected = outcome == 1;
+        for (int i = 0; i < LATENCY_STAGES; ++i)
+        {
+            if (rejected && (i == 1 || i == 2))
+                continue;
+            latency.histograms[i][outcome].record(
+                static_cast<std::uint64_t>(stageTicks[i] * nanosPerTick));
+        }
+    }
+};
+
+#else
+
+class LatencyRecorder
+{
+public:
+    void begin() {}
+    void validated() {}
+    void lookedUp() {}
+    void beginEmit() {}
+    void endEmit() {}
+    void finish(InstrumentType, int) {}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "OrderGenerator.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+
+using namespace std;
+
+// Load generator for the server mode of main (--listen-tcp/--listen-unix).
+// Sends a seeded synthetic order flow from OrderGenerator over one or more
+// connections as fast as the server takes it, or at --rate orders a second,
+// and reads the reports back. The server numbers each connection's orders in
+// the order they were sent, so the first report with a new order ID on a
+// connection belongs to that connection's next unacknowledged order; the
+// time from sending an order to that report is its acknowledgement latency.
+
+typedef chrono::steady_clock Clock;
+
+struct ClientConnection
+{
+    int fd = -1;
+    string outgoing;
+    size_t written = 0;
+    vector<size_t> lineEnds;
+    size_t sent = 0;
+    vector<Clock::time_point> sentAt;
+    string incoming;
+    int lastOrderId = 0;
+    size_t acknowledged = 0;
+    size_t reports = 0;
+};
+
+int connectTo(int port, const string &unixPath)
+{
+    int fd;
+    if (!unixPath.empty())
+    {
+        sockaddr_un address = {};
+        if (unixPath.size() >= sizeof(address.sun_path))
+            return -1;
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, unixPath.c_str(), unixPath.size() + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// Sends the connection's first due lines, as far as the socket takes them.
+void sendSome(ClientConnection &connection, size_t due)
+{
+    size_t limit = due == 0 ? 0 : connection.lineEnds[due - 1] + 1;
+    while (connection.written < limit)
+    {
+        ssize_t count = send(connection.fd, connection.outgoing.data() + connection.written,
+                             limit - connection.written, MSG_NOSIGNAL);
+        if (count <= 0)
+            break;
+        connection.written += count;
+    }
+    Clock::time_point now = Clock::now();
+    while (connection.sent < connection.lineEnds.size() && connection.lineEnds[connection.sent] < connection.written)
+        connection.sentAt[connection.sent++] = now;
+}
+
+// Returns false once the server has closed the connection.
+bool receiveSome(ClientConnection &connection, vector<long long> &latencies)
+{
+    char buffer[64 * 1024];
+    ssize_t count = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+        return false;
+    if (count < 0)
+        return true;
+
+    Clock::time_point now = Clock::now();
+    connection.incoming.append(buffer, count);
+    LineScanner lines(connection.incoming);
+    size_t consumed = 0;
+    string_view line;
+    while (connection.incoming.find('\n', consumed) != string::npos && lines.next(line))
+    {
+        consumed += line.size() + 1;
+        ++connection.reports;
+        size_t start = line.find(",ord");
+        int orderId = 0;
+        if (start == string_view::npos || !parseInt(line.substr(start + 4), orderId))
+            continue;
+        if (orderId > connection.lastOrderId && connection.acknowledged < connection.sent)
+        {
+            connection.lastOrderId = orderId;
+            latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(
+                                    now - connection.sentAt[connection.acknowledged++])
+                                    .count());
+        }
+    }
+    connection.incoming.erase(0, consumed);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorConfig config;
+    config.orders = 100000;
+    int port = -1;
+    string unixPath;
+    int connectionCount = 1;
+    double rate = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--tcp" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (arg == "--unix" && i + 1 < argc)
+            unixPath = argv[++i];
+        else if (arg == "--connections" && i + 1 < argc)
+            connectionCount = max(atoi(argv[++i]), 1);
+        else if (arg == "--orders" && i + 1 < argc)
+            config.orders = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--aggressive" && i + 1 < argc)
+            config.aggressiveRatio = atof(argv[++i]);
+        else if (arg == "--invalid" && i + 1 < argc)
+            config.invalidRate = atof(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc)
+            rate = max(atof(argv[++i]), 0.0);
+        else
+        {
+            port = -1;
+            unixPath.clear();
+            break;
+        }
+    }
+    if (port < 0 && unixPath.empty())
+    {
+        cerr << "Usage: " << argv[0] << " --tcp PORT | --unix PATH [--connections N] [--orders N] [--seed N]"
+             << " [--aggressive RATIO] [--invalid RATIO] [--rate ORDERS_PER_SECOND]" << endl;
+        return 1;
+    }
+
+    string orders;
+    {
+        ReportWriter output(orders);
+        OrderGenerator generator(config);
+        while (generator.next(output))
+        {
+        }
+    }
+
+    vector<ClientConnection> connections(connectionCount);
+    {
+        LineScanner lines(orders);
+        string_view line;
+        size_t index = 0;
+        while (lines.next(line))
+        {
+            ClientConnection &connection = connections[index++ % connections.size()];
+            connection.outgoing.append(line.data(), line.size()).append(1, '\n');
+            connection.lineEnds.push_back(connection.outgoing.size() - 1);
+        }
+    }
+    for (ClientConnection &connection : connections)
+    {
+        connection.sentAt.resize(connection.lineEnds.size());
+        connection.fd = connectTo(port, unixPath);
+        if (connection.fd < 0)
+        {
+            cerr << "Error: Could not connect" << endl;
+            return 1;
+        }
+    }
+
+    vector<long long> latencies;
+    latencies.reserve(config.orders);
+    vector<pollfd> polls(connections.size());
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastProgress = start;
+    size_t open = connections.size();
+    // Orders are dealt round-robin, so with --rate line k of connection i is
+    // order k * connections + i of the whole flow. While orders are still to
+    // come, poll does not sleep, so each one goes out when it is due.
+    vector<size_t> due(connections.size());
+    for (;;)
+    {
+        size_t pending = 0;
+        size_t dueOrders = static_cast<size_t>(chrono::duration<double>(Clock::now() - start).count() * rate);
+        bool paced = rate > 0 && dueOrders < config.orders;
+        for (size_t i = 0; i < connections.size(); ++i)
+        {
+            ClientConnection &connection = connections[i];
+            due[i] = connection.lineEnds.size();
+            if (paced)
+                due[i] = min(due[i], dueOrders / connections.size() + (i < dueOrders % connections.size() ? 1 : 0));
+            pending += connection.lineEnds.size() - connection.acknowledged;
+            polls[i].fd = connection.fd;
+            polls[i].events = POLLIN | (connection.sent < due[i] ? POLLOUT : 0);
+            polls[i].revents = 0;
+        }
+        if (pending == 0 || open == 0)
+            break;
+        if (paced)
+            lastProgress = Clock::now();
+        else if (Clock::now() - lastProgress > chrono::seconds(5))
+        {
+            cerr << "Warning: No reports for 5 seconds, " << pending << " orders unacknowledged" << endl;
+            break;
+        }
+
+        if (poll(polls.data(), polls.size(), paced ? 0 : 100) < 0 && errno != EINTR)
+            break;
+        for (size_t i = 0; i < connections.size(); ++i)
+        {
+            ClientConnection &connection = connections[i];
+            if (connection.fd < 0)
+                continue;
+            if (polls[i].revents & POLLOUT)
+                sendSome(connection, due[i]);
+            if (polls[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                size_t before = connection.reports;
+                if (!receiveSome(connection, latencies))
+                {
+                    close(connection.fd);
+                    connection.fd = -1;
+                    --open;
+                }
+                if (connection.reports != before)
+                    lastProgress = Clock::now();
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    size_t reports = 0;
+    for (ClientConnection &connection : connections)
+    {
+        reports += connection.reports;
+        if (connection.fd >= 0)
+            close(connection.fd);
+    }
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double fraction)
+    {
+        return latencies.empty() ? 0 : latencies[static_cast<size_t>(fraction * (latencies.size() - 1) + 0.5)] / 1000;
+    };
+    cout << "Orders: " << latencies.size() << " acknowledged of " << config.orders << " over " << connections.size()
+         << " connections, " << reports << " execution reports" << endl;
+    cout << "Throughput: " << static_cast<long long>(seconds > 0 ? latencies.size() / seconds : 0) << " orders/s in "
+         << seconds * 1000 << " ms" << endl;
+    cout << "Acknowledgement latency us: p50 " << percentile(0.5) << " p90 " << percentile(0.9) << " p99 "
+         << percentile(0.99) << " p99.9 " << percentile(0.999) << " max " << percentile(1.0) << endl;
+    return 0;
+}
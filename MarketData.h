@@ -0,0 +1,199 @@
+#ifndef MARKET_DATA_H
+#define MARKET_DATA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "ReportWriter.h"
+
+// Market-data feed for an OrderBook, written as CSV lines:
+//
+//   L2,seq,instrument,side,Add|Change|Delete,price,quantity
+//   L1,seq,instrument,bid price,bid quantity,ask price,ask quantity
+//   Depth,seq,instrument,side,level,price,quantity
+//
+// L2 lines are incremental updates of the aggregated quantity at one price
+// level; L1 lines give the new top of book of an instrument whenever its
+// best price or the quantity there changed (an empty side has empty fields).
+// Both are published once per processed order, after comparing each level
+// the order touched with its total before the order, so a level that was
+// changed and changed back produces nothing. Depth lines form an on-demand
+// snapshot of the best levels of every book, read without changing it.
+// seq increases by one per line, so consumers can spot gaps.
+
+const int MARKET_DATA_ADD = 0;
+const int MARKET_DATA_CHANGE = 1;
+const int MARKET_DATA_DELETE = 2;
+
+inline const char *levelActionToString(int action)
+{
+    switch (action)
+    {
+    case MARKET_DATA_ADD:
+        return "Add";
+    case MARKET_DATA_CHANGE:
+        return "Change";
+    default:
+        return "Delete";
+    }
+}
+
+struct TopOfBook
+{
+    long long bidPrice = 0;
+    int bidQuantity = 0;
+    long long askPrice = 0;
+    int askQuantity = 0;
+
+    bool operator==(const TopOfBook &other) const
+    {
+        return bidPrice == other.bidPrice && bidQuantity == other.bidQuantity && askPrice == other.askPrice &&
+               askQuantity == other.askQuantity;
+    }
+};
+
+class MarketDataPublisher
+{
+private:
+    OrderBook &orderBook;
+    ReportWriter &output;
+    std::vector<LevelChange> changes;
+    std::vector<TopOfBook> published;
+    // Instruments whose levels changed since the last publish, and a flag
+    // per instrument for whether it is already listed.
+    std::vector<int> touched;
+    std::vector<char> isTouched;
+    std::uint64_t sequence = 0;
+
+    void writeLevelUpdate(const LevelChange &change, int quantity)
+    {
+        int action = change.quantityBefore == 0 ? MARKET_DATA_ADD
+                     : quantity == 0            ? MARKET_DATA_DELETE
+                                                : MARKET_DATA_CHANGE;
+        output.append("L2,").appendInt(static_cast<long long>(++sequence)).append(',')
+            .append(instrumentToString(change.instrument)).append(',')
+            .appendInt(change.side).append(',')
+            .append(levelActionToString(action)).append(',')
+            .appendFixed(change.price, PRICE_DECIMALS).append(',')
+            .appendInt(quantity);
+        output.endRecord();
+    }
+
+    TopOfBook topOf(InstrumentType instrument) const
+    {
+        TopOfBook top;
+        orderBook.forEachLevel(instrument, 1, 1, [&top](long long price, int quantity)
+                               {
+            top.bidPrice = price;
+            top.bidQuantity = quantity; });
+        orderBook.forEachLevel(instrument, 2, 1, [&top](long long price, int quantity)
+                               {
+            top.askPrice = price;
+            top.askQuantity = quantity; });
+        return top;
+    }
+
+    void appendSide(long long price, int quantity)
+    {
+        if (quantity == 0)
+        {
+            output.append(',').append(',');
+            return;
+        }
+        output.append(',').appendFixed(price, PRICE_DECIMALS).append(',').appendInt(quantity);
+    }
+
+    void writeTopOfBook(InstrumentType instrument, const TopOfBook &top)
+    {
+        output.append("L1,").appendInt(static_cast<long long>(++sequence)).append(',')
+            .append(instrumentToString(instrument));
+        appendSide(top.bidPrice, top.bidQuantity);
+        appendSide(top.askPrice, top.askQuantity);
+        output.endRecord();
+    }
+
+public:
+    // Starts logging the book's level changes; the book must outlive the
+    // publisher.
+    MarketDataPublisher(OrderBook &orderBook, ReportWriter &output) : orderBook(orderBook), output(output)
+    {
+        changes.reserve(64);
+        orderBook.logLevelChanges(&changes);
+        published.resize(instrumentCount());
+        isTouched.resize(instrumentCount());
+        for (int i = 0; i < instrumentCount(); ++i)
+            published[i] = topOf(static_cast<InstrumentType>(i));
+    }
+
+    MarketDataPublisher(const MarketDataPublisher &) = delete;
+    MarketDataPublisher &operator=(const MarketDataPublisher &) = delete;
+
+    ~MarketDataPublisher()
+    {
+        orderBook.logLevelChanges(nullptr);
+    }
+
+    // Publishes what changed since the last call; call it after every
+    // order, cancel or amend.
+    void publish()
+    {
+        if (changes.empty())
+            return;
+
+        for (const LevelChange &change : changes)
+        {
+            int quantity = change.ladder->quantityAt(change.price);
+            if (quantity == change.quantityBefore)
+                continue;
+            writeLevelUpdate(change, quantity);
+            int id = static_cast<int>(change.instrument);
+            if (!isTouched[id])
+            {
+                isTouched[id] = 1;
+                touched.push_back(id);
+            }
+        }
+        changes.clear();
+
+        std::sort(touched.begin(), touched.end());
+        for (int i : touched)
+        {
+            isTouched[i] = 0;
+            InstrumentType instrument = static_cast<InstrumentType>(i);
+            TopOfBook top = topOf(instrument);
+            if (top == published[i])
+                continue;
+            published[i] = top;
+            writeTopOfBook(instrument, top);
+        }
+        touched.clear();
+    }
+
+    // Writes the best depth levels of each side of every instrument's book.
+    void writeDepthSnapshot(int depth)
+    {
+        for (int i = 0; i < instrumentCount(); ++i)
+        {
+            InstrumentType instrument = static_cast<InstrumentType>(i);
+            for (int side = 1; side <= 2; ++side)
+            {
+                int level = 0;
+                orderBook.forEachLevel(instrument, side, depth, [&](long long price, int quantity)
+                                       {
+                    output.append("Depth,").appendInt(static_cast<long long>(++sequence)).append(',')
+                        .append(instrumentToString(instrument)).append(',')
+                        .appendInt(side).append(',')
+                        .appendInt(++level).append(',')
+                        .appendFixed(price, PRICE_DECIMALS).append(',')
+                        .appendInt(quantity);
+                    output.endRecord(); });
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MATCHING_ENGINE_H
+#define MATCHING_ENGINE_H
+
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderParser.h"
+
+// An exchange engine to embed in another program: one OrderBook with its own
+// order ID sequence, handing every execution report to a sink instead of a
+// file. Engines share no state apart from the instrument universe (see
+// InstrumentUniverse.h), so a process can run any number of them; load the
+// universe before creating the first one.
+//
+// Sink is any callable taking a const ExecutionReport &, e.g. a lambda. It is
+// called synchronously, in report order, while an order is processed; the
+// report's clientOrderId only stays valid during the call (see
+// ExecutionReport), so a sink that keeps reports should copy them into a
+// StoredReport.
+template <typename Sink>
+class MatchingEngine
+{
+    static_assert(std::is_invocable_v<Sink &, const ExecutionReport &>,
+                  "Sink must be callable with a const ExecutionReport &");
+
+private:
+    OrderBook orderBook;
+    Sink sink;
+
+    friend void writeExecutionReport(const ExecutionReport &report, MatchingEngine &engine)
+    {
+        engine.sink(report);
+    }
+
+public:
+    explicit MatchingEngine(Sink sink) : sink(std::move(sink))
+    {
+    }
+
+    MatchingEngine(const MatchingEngine &) = delete;
+    MatchingEngine &operator=(const MatchingEngine &) = delete;
+
+    // Numbers, validates and matches an order and returns its order ID.
+    // clientOrderId must stay alive until submit returns.
+    int submit(Order order)
+    {
+        orderBook.processOrder(order, *this);
+        return order.orderId;
+    }
+
+    // Submits one line in the orders.csv format. Returns the order ID, or 0
+    // for a line that is not an order (like a header), which gets no ID.
+    int submit(std::string_view line)
+    {
+        Order order;
+        if (!parseOrderLine(line, order))
+            return 0;
+        return submit(order);
+    }
+
+    // Takes a resting order off the book without a report; false if it is
+    // not resting.
+    bool cancel(int orderId)
+    {
+        return orderBook.cancelOrder(orderId);
+    }
+
+    // Changes a resting order's price and quantity (see
+    // OrderBook::amendOrder); 0 if it was amended, -1 if it is not
+    // resting, or the reject reason for new values that are invalid or
+    // breach a risk limit.
+    int amend(int orderId, long long price, int quantity)
+    {
+        return orderBook.amendOrder(orderId, price, quantity, *this);
+    }
+
+    // Looks up a live order by order ID (see OrderBook::findOrder); false
+    // if it is not resting or a pending stop.
+    bool find(int orderId, OrderState &state) const
+    {
+        return orderBook.findOrder(orderId, state);
+    }
+
+    // Uncrosses a call auction now (see OrderBook::scheduleAuction), e.g.
+    // when the session's orders have all been submitted.
+    void uncross()
+    {
+        orderBook.uncross(*this);
+    }
+
+    int lastOrderId() const
+    {
+        return orderBook.lastAssignedOrderId();
+    }
+
+    OrderBook &book()
+    {
+        return orderBook;
+    }
+
+    const OrderBook &book() const
+    {
+        return orderBook;
+    }
+
+    Sink &reportSink()
+    {
+        return sink;
+    }
+};
+
+// Deduces the sink type, e.g.
+//   auto engine = makeMatchingEngine([&](const ExecutionReport &report) { ... });
+template <typename Sink>
+MatchingEngine<Sink> makeMatchingEngine(Sink sink)
+{
+    return MatchingEngine<Sink>(std::move(sink));
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "InstrumentUniverse.h"
+#include "ReportWriter.h"
+
+// Instruments are listed in the instrument universe (see
+// InstrumentUniverse.h); these resolve them through the one in use.
+inline int instrumentCount()
+{
+    return instrumentUniverse().size();
+}
+
+// Returns "Invalid" for an instrument that is not listed. The name lives as
+// long as the universe.
+inline std::string_view instrumentToString(InstrumentType inst)
+{
+    return instrumentUniverse().name(inst);
+}
+
+inline InstrumentType stringToInstrument(std::string_view ins)
+{
+    return instrumentUniverse().find(ins);
+}
+
+// instrument must not be Invalid.
+inline const InstrumentRules &rulesFor(InstrumentType instrument)
+{
+    return instrumentUniverse().rules(instrument);
+}
+
+inline std::string statusToString(int status)
+{
+    switch (status)
+    {
+    case 0:
+        return "New";
+    case 1:
+        return "Reject";
+    case 2:
+        return "Fill";
+    case 3:
+        return "PFill";
+    case 4:
+        return "Cancel";
+    case 5:
+        return "Expire";
+    default:
+        return "Unknown";
+    }
+}
+
+const int STATUS_COUNT = 6;
+
+// Order types, from the optional sixth column of orders.csv. A limit order
+// rests whatever it does not fill. A market order takes any price and an
+// immediate-or-cancel order its limit price or better; what they do not fill
+// is cancelled. A fill-or-kill order fills in full at its limit price or
+// better, or expires without trading. A stop order waits until a trade at
+// its price or beyond (at or above for a buy, at or below for a sell) and
+// then runs as a market order.
+const int ORDER_LIMIT = 0;
+const int ORDER_MARKET = 1;
+const int ORDER_IOC = 2;
+const int ORDER_FOK = 3;
+const int ORDER_STOP = 4;
+const int ORDER_TYPE_COUNT = 5;
+
+inline const char *orderTypeToString(int type)
+{
+    switch (type)
+    {
+    case ORDER_LIMIT:
+        return "Limit";
+    case ORDER_MARKET:
+        return "Market";
+    case ORDER_IOC:
+        return "IOC";
+    case ORDER_FOK:
+        return "FOK";
+    case ORDER_STOP:
+        return "Stop";
+    default:
+        return "Invalid";
+    }
+}
+
+// Returns ORDER_TYPE_COUNT for a name that is not an order type.
+inline int stringToOrderType(std::string_view type)
+{
+    for (int i = 0; i < ORDER_TYPE_COUNT; ++i)
+    {
+        if (type == orderTypeToString(i))
+            return i;
+    }
+    return ORDER_TYPE_COUNT;
+}
+
+// Reject reasons are codes like statuses; 0 means no reason. Reasons 1-7 are
+// the static field checks, 8-11 the pre-trade risk limits (see
+// PreTradeRisk.h) and 12 an order type a call auction does not take.
+inline const char *reasonToString(int reason)
+{
+    switch (reason)
+    {
+    case 1:
+        return "Invalid client order ID";
+    case 2:
+        return "Invalid instrument";
+    case 3:
+        return "Invalid side";
+    case 4:
+        return "Invalid price";
+    case 5:
+        return "Invalid quantity";
+    case 6:
+        return "Invalid order type";
+    case 7:
+        return "Invalid account";
+    case 8:
+        return "Price outside collar";
+    case 9:
+        return "Order notional too large";
+    case 10:
+        return "Open quantity limit reached";
+    case 11:
+        return "Order rate limit reached";
+    case 12:
+        return "Not allowed in auction";
+    default:
+        return "";
+    }
+}
+
+const int REASON_COUNT = 13;
+
+// Longest account name. Binary files and the journal store accounts in 16
+// bytes, so a longer name they truncate is still too long.
+const std::size_t ACCOUNT_CAPACITY = 15;
+
+// Client order ID stored inline. processOrder only accepts IDs of 1-7
+// characters, so every resting order's ID fits in 8 NUL-padded bytes.
+struct SmallId
+{
+    static constexpr std::size_t CAPACITY = 8;
+
+    char text[CAPACITY] = {};
+
+    SmallId() = default;
+
+    explicit SmallId(std::string_view id)
+    {
+        std::memcpy(text, id.data(), id.size() < CAPACITY ? id.size() : CAPACITY);
+    }
+
+    std::string_view view() const
+    {
+        std::size_t length = 0;
+        while (length < CAPACITY && text[length] != '\0')
+            ++length;
+        return std::string_view(text, length);
+    }
+};
+
+// clientOrderId refers to the text the order was read from, which must stay
+// alive until the order has been processed; orders that rest in a book keep
+// their own SmallId copy. price is the limit price, the trigger price of a
+// stop order, and unused for a market order. account is the optional
+// client/account name, refers to the input text like clientOrderId, and is
+// empty for none; accountId is its number in the book's AccountTable, set
+// by the book unless the caller already set it with
+// OrderBook::accountIdFor. Readers reset it with every order they read.
+struct Order
+{
+    std::string_view clientOrderId;
+    InstrumentType instrument;
+    int side;
+    long long price;
+    int quantity;
+    int orderId;
+    int type = ORDER_LIMIT;
+    std::string_view account;
+    int accountId = 0;
+};
+
+// clientOrderId refers either to the incoming order's text or to the resting
+// order's ID, so a report must be written before the book changes again.
+struct ExecutionReport
+{
+    std::string_view clientOrderId;
+    int orderId;
+    InstrumentType instrument;
+    long long price;
+    int quantity;
+    int status;
+    int side;
+    int reason = 0;
+};
+
+// A report kept after the book has moved on. Resting orders' IDs live in pool
+// slots that get reused, so IDs that fit are copied inline; longer IDs only
+// ever come from incoming orders and keep referring to their input text.
+struct StoredReport
+{
+    ExecutionReport report;
+    SmallId clientOrderId;
+
+    void store(const ExecutionReport &executionReport)
+    {
+        report = executionReport;
+        if (report.clientOrderId.size() <= SmallId::CAPACITY)
+            clientOrderId = SmallId(report.clientOrderId);
+    }
+
+    ExecutionReport get() const
+    {
+        ExecutionReport executionReport = report;
+        if (executionReport.clientOrderId.size() <= SmallId::CAPACITY)
+            executionReport.clientOrderId = clientOrderId.view();
+        return executionReport;
+    }
+};
+
+inline void writeExecutionReport(const ExecutionReport &report, ReportWriter &output)
+{
+    output.append(report.clientOrderId).append(',')
+        .append("ord").appendInt(report.orderId).append(',')
+        .append(instrumentToString(report.instrument)).append(',')
+        .appendInt(report.side).append(',')
+        .append(statusToString(report.status)).append(',')
+        .appendInt(report.quantity).append(',')
+        .appendFixed(report.price, PRICE_DECIMALS);
+    if (report.reason != 0)
+    {
+        output.append(',').append(reasonToString(report.reason));
+    }
+    output.endRecord();
+}
+
+// A live order as its book holds it now (see OrderBook::findOrder): a limit
+// order resting in a book, or a stop order waiting for its trigger price,
+// which is then its price. status is New until the order first fills and
+// PFill after that. filledNotional adds up price times quantity of its
+// fills, in ticks.
+struct OrderState
+{
+    SmallId clientOrderId;
+    int orderId;
+    InstrumentType instrument;
+    int side;
+    int type;
+    long long price;
+    int status;
+    int remainingQuantity;
+    int filledQuantity;
+    long long filledNotional;
+
+    // Average fill price in ten-thousandths, rounded half up; 0 before the
+    // first fill.
+    long long averagePrice() const
+    {
+        const long long scale = 10000 / TICKS_PER_UNIT;
+        return filledQuantity == 0 ? 0 : (filledNotional * scale + filledQuantity / 2) / filledQuantity;
+    }
+};
+
+const int AVERAGE_PRICE_DECIMALS = 4;
+
+// Writes an order state as one line:
+//   Order,order ID,client order ID,instrument,side,type,status,price,
+//   remaining quantity,filled quantity,average fill price
+inline void writeOrderState(const OrderState &state, ReportWriter &output)
+{
+    output.append("Order,")
+        .append("ord").appendInt(state.orderId).append(',')
+        .append(state.clientOrderId.view()).append(',')
+        .append(instrumentToString(state.instrument)).append(',')
+        .appendInt(state.side).append(',')
+        .append(orderTypeToString(state.type)).append(',')
+        .append(statusToString(state.status)).append(',')
+        .appendFixed(state.price, PRICE_DECIMALS).append(',')
+        .appendInt(state.remainingQuantity).append(',')
+        .appendInt(state.filledQuantity).append(',')
+        .appendFixed(state.averagePrice(), AVERAGE_PRICE_DECIMALS);
+    output.endRecord();
+}
+
+#endif
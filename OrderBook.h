@@ -0,0 +1,1502 @@
+#ifndef ORDER_BOOK_H
+#define ORDER_BOOK_H
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "Accounts.h"
+#include "LatencyStats.h"
+#include "Order.h"
+#include "OrderPool.h"
+#include "PreTradeRisk.h"
+
+// Orders resting at one price, oldest first, chained through their pool slots.
+// Walking a level from head to tail gives the same price-time order the old
+// BuySideComparator/SellSideComparator heaps produced, since order IDs only
+// ever grow.
+struct PriceLevel
+{
+    int totalQuantity = 0;
+    int head = -1;
+    int tail = -1;
+};
+
+class PriceLadder;
+
+// One match between an incoming order, on aggressorSide, and a resting one.
+// Trades of an auction uncross have no aggressor and aggressorSide 0.
+struct Trade
+{
+    InstrumentType instrument;
+    long long price;
+    int quantity;
+    int aggressorSide;
+    int buyOrderId;
+    int sellOrderId;
+};
+
+// Orders with IDs firstOrderId to lastOrderId are collected in a call auction
+// (see OrderBook::scheduleAuction).
+struct AuctionWindow
+{
+    int firstOrderId;
+    int lastOrderId;
+};
+
+// Outcome of uncrossing one instrument: the price everything trades at, the
+// quantity that trades and the quantity left over at that price, positive on
+// the buy side and negative on the sell side. volume is 0 if the book is not
+// crossed.
+struct AuctionResult
+{
+    long long price = 0;
+    long long volume = 0;
+    long long surplus = 0;
+};
+
+// A level whose total quantity changed, with its total before the first
+// change since the log was last cleared.
+struct LevelChange
+{
+    const PriceLadder *ladder;
+    InstrumentType instrument;
+    int side;
+    long long price;
+    int quantityBefore;
+};
+
+// One side of an instrument's book as a dense array of levels indexed by
+// tick. The best level is tracked by index and only rescanned when it empties.
+class PriceLadder
+{
+private:
+    OrderPool *pool;
+    long long minTick;
+    bool descending;
+    InstrumentType instrument;
+    std::vector<PriceLevel> levels;
+    int best = 0;
+    int activeLevels = 0;
+    std::vector<LevelChange> *changes = nullptr;
+
+    void noteChange(int index)
+    {
+        if (changes == nullptr)
+            return;
+        long long price = minTick + index;
+        for (const LevelChange &change : *changes)
+        {
+            if (change.ladder == this && change.price == price)
+                return;
+        }
+        changes->push_back(LevelChange{this, instrument, descending ? 1 : 2, price, levels[index].totalQuantity});
+    }
+
+    void findNextBest()
+    {
+        if (activeLevels == 0)
+            return;
+        if (descending)
+            while (levels[best].head < 0)
+                --best;
+        else
+            while (levels[best].head < 0)
+                ++best;
+    }
+
+public:
+    PriceLadder(OrderPool &pool, const PriceBand &band, bool descending, InstrumentType instrument)
+        : pool(&pool), minTick(band.minTick), descending(descending), instrument(instrument),
+          levels(band.maxTick - band.minTick + 1)
+    {
+    }
+
+    // Starts or stops logging level changes into changes.
+    void logChanges(std::vector<LevelChange> *log)
+    {
+        changes = log;
+    }
+
+    InstrumentType instrumentType() const
+    {
+        return instrument;
+    }
+
+    int quantityAt(long long price) const
+    {
+        return levels[price - minTick].totalQuantity;
+    }
+
+    // Visits up to count non-empty levels from the best one outwards.
+    template <typename Visit>
+    void forEachLevel(int count, Visit visit) const
+    {
+        if (activeLevels == 0)
+            return;
+        int step = descending ? -1 : 1;
+        int size = static_cast<int>(levels.size());
+        for (int index = best; count > 0 && index >= 0 && index < size; index += step)
+        {
+            if (levels[index].head < 0)
+                continue;
+            visit(minTick + index, levels[index].totalQuantity);
+            --count;
+        }
+    }
+
+    // Adds up the level totals from the best level out to limit, stopping
+    // as soon as they reach wanted, so a fill-or-kill check only reads the
+    // levels it could fill from. With a nonzero account the orders of that
+    // account are not counted, and if stopAtOwn is set the count ends at the
+    // first of them, since self-trade prevention would cancel or cut the
+    // incoming order there.
+    int quantityUpTo(long long limit, int wanted, int account = 0, bool stopAtOwn = false) const
+    {
+        if (activeLevels == 0)
+            return 0;
+        long long last = std::max(-1LL, std::min(limit - minTick, static_cast<long long>(levels.size())));
+        long long size = static_cast<long long>(levels.size());
+        long long step = descending ? -1 : 1;
+        int total = 0;
+        for (long long index = best; (descending ? index >= last : index <= last) && index >= 0 && index < size &&
+                                     total < wanted; index += step)
+        {
+            if (account == 0)
+            {
+                total += levels[index].totalQuantity;
+                continue;
+            }
+            for (int slot = levels[index].head; slot >= 0 && total < wanted; slot = (*pool)[slot].next)
+            {
+                const RestingOrder &resting = (*pool)[slot];
+                if (resting.account != account)
+                    total += resting.quantity;
+                else if (stopAtOwn)
+                    return total;
+            }
+        }
+        return total;
+    }
+
+    bool empty() const
+    {
+        return activeLevels == 0;
+    }
+
+    long long bestPrice() const
+    {
+        return minTick + best;
+    }
+
+    PriceLevel &bestLevel()
+    {
+        return levels[best];
+    }
+
+    void add(int slot)
+    {
+        RestingOrder &order = (*pool)[slot];
+        int index = static_cast<int>(order.price - minTick);
+        noteChange(index);
+        PriceLevel &level = levels[index];
+        order.previous = level.tail;
+        order.next = -1;
+        if (level.tail < 0)
+        {
+            level.head = slot;
+            if (activeLevels == 0 || (descending ? index > best : index < best))
+                best = index;
+            ++activeLevels;
+        }
+        else
+        {
+            (*pool)[level.tail].next = slot;
+        }
+        level.tail = slot;
+        level.totalQuantity += order.quantity;
+    }
+
+    void remove(int slot)
+    {
+        RestingOrder &order = (*pool)[slot];
+        int index = static_cast<int>(order.price - minTick);
+        noteChange(index);
+        PriceLevel &level = levels[index];
+        level.totalQuantity -= order.quantity;
+        if (order.previous < 0)
+            level.head = order.next;
+        else
+            (*pool)[order.previous].next = order.next;
+        if (order.next < 0)
+            level.tail = order.previous;
+        else
+            (*pool)[order.next].previous = order.previous;
+
+        if (level.head < 0)
+        {
+            --activeLevels;
+            if (index == best)
+                findNextBest();
+        }
+    }
+
+    void reduce(int slot, int quantity)
+    {
+        RestingOrder &order = (*pool)[slot];
+        noteChange(static_cast<int>(order.price - minTick));
+        levels[order.price - minTick].totalQuantity -= quantity;
+        order.quantity -= quantity;
+    }
+
+    // Visits every resting order, oldest first within each level.
+    template <typename Visit>
+    void forEachOrder(Visit visit) const
+    {
+        if (activeLevels == 0)
+            return;
+        for (const PriceLevel &level : levels)
+        {
+            for (int slot = level.head; slot >= 0; slot = (*pool)[slot].next)
+                visit((*pool)[slot]);
+        }
+    }
+};
+
+// Pending stop orders by trigger price. Buy stops are kept lowest first and
+// sell stops highest first, so the stops a trade triggers are always at the
+// best end of their ladder.
+struct StopLadders
+{
+    PriceLadder buyStops;
+    PriceLadder sellStops;
+
+    StopLadders(OrderPool &pool, const PriceBand &band, InstrumentType instrument)
+        : buyStops(pool, band, false, instrument), sellStops(pool, band, true, instrument)
+    {
+    }
+};
+
+struct InstrumentBook
+{
+    PriceLadder buySide;
+    PriceLadder sellSide;
+    // Created with the first stop order, so books without stops do not pay
+    // for their ladders.
+    std::unique_ptr<StopLadders> stops;
+    long long lastTradePrice = 0;
+    // Highest and lowest trade price since stops were last checked.
+    long long tradeHigh = 0;
+    long long tradeLow = LLONG_MAX;
+
+    InstrumentBook(OrderPool &pool, const PriceBand &band, InstrumentType instrument)
+        : buySide(pool, band, true, instrument), sellSide(pool, band, false, instrument)
+    {
+    }
+
+    void noteTrade(long long price)
+    {
+        lastTradePrice = price;
+        tradeHigh = std::max(tradeHigh, price);
+        tradeLow = std::min(tradeLow, price);
+    }
+};
+
+// Compile-time description of the side an incoming order is on: where it
+// rests, what it matches against, and which resting prices cross its limit.
+struct BuySide
+{
+    static constexpr int SIDE = 1;
+    static constexpr long long ANY_PRICE = LLONG_MAX;
+
+    static constexpr bool crosses(long long restingPrice, long long limit)
+    {
+        return restingPrice <= limit;
+    }
+
+    static PriceLadder &own(InstrumentBook &orderBook)
+    {
+        return orderBook.buySide;
+    }
+
+    static PriceLadder &opposite(InstrumentBook &orderBook)
+    {
+        return orderBook.sellSide;
+    }
+};
+
+struct SellSide
+{
+    static constexpr int SIDE = 2;
+    static constexpr long long ANY_PRICE = LLONG_MIN;
+
+    static constexpr bool crosses(long long restingPrice, long long limit)
+    {
+        return restingPrice >= limit;
+    }
+
+    static PriceLadder &own(InstrumentBook &orderBook)
+    {
+        return orderBook.sellSide;
+    }
+
+    static PriceLadder &opposite(InstrumentBook &orderBook)
+    {
+        return orderBook.buySide;
+    }
+};
+
+class OrderBook
+{
+private:
+    const InstrumentUniverse *universe;
+    OrderPool pool;
+    OrderPool stopPool;
+    OrderIndex restingOrders;
+    OrderIndex stopOrders;
+    // Kept only after indexClientOrderIds.
+    ClientOrderIndex clientOrders;
+    bool clientOrdersIndexed = false;
+    // Indexed by instrument; a book is created when its instrument is first
+    // used.
+    std::vector<std::unique_ptr<InstrumentBook>> orderBooks;
+    LatencyRecorder latency;
+    std::vector<LevelChange> *levelChanges = nullptr;
+    std::vector<Trade> *tradeLog = nullptr;
+    int lastOrderId = 0;
+    AccountTable accounts;
+    int selfTradePrevention = STP_NONE;
+    AccountRisk risk;
+    std::vector<AuctionWindow> auctions;
+    std::size_t nextAuction = 0;
+    bool callPhase = false;
+
+    InstrumentBook &bookFor(InstrumentType instrument)
+    {
+        std::unique_ptr<InstrumentBook> &orderBook = orderBooks[static_cast<std::size_t>(instrument)];
+        if (!orderBook)
+        {
+            orderBook = std::make_unique<InstrumentBook>(pool, universe->rules(instrument).band, instrument);
+            orderBook->buySide.logChanges(levelChanges);
+            orderBook->sellSide.logChanges(levelChanges);
+        }
+        return *orderBook;
+    }
+
+    // nullptr if the instrument is not listed or has no book yet.
+    const InstrumentBook *findBook(InstrumentType instrument) const
+    {
+        std::size_t id = static_cast<std::size_t>(instrument);
+        return id < orderBooks.size() ? orderBooks[id].get() : nullptr;
+    }
+
+    PriceLadder &sideFor(const RestingOrder &order)
+    {
+        InstrumentBook &orderBook = bookFor(order.instrument);
+        return order.side == 1 ? orderBook.buySide : orderBook.sellSide;
+    }
+
+    // Rests what is left of an order, with the fills it already had.
+    void rest(const Order &order, PriceLadder &side, int filledQuantity = 0, long long filledNotional = 0)
+    {
+        int slot = pool.allocate();
+        RestingOrder &resting = pool[slot];
+        resting.clientOrderId = SmallId(order.clientOrderId);
+        resting.price = order.price;
+        resting.orderId = order.orderId;
+        resting.quantity = order.quantity;
+        resting.side = order.side;
+        resting.instrument = order.instrument;
+        resting.account = order.accountId;
+        resting.filledQuantity = filledQuantity;
+        pool.filledNotional(slot) = filledNotional;
+        side.add(slot);
+        restingOrders.insert(order.orderId, slot);
+        if (clientOrdersIndexed)
+            clientOrders.insert(resting.clientOrderId, order.orderId);
+        risk.changeOpen(order.accountId, order.quantity);
+    }
+
+    void unrest(int slot, PriceLadder &side)
+    {
+        risk.changeOpen(pool[slot].account, -pool[slot].quantity);
+        side.remove(slot);
+        restingOrders.erase(pool[slot].orderId);
+        if (clientOrdersIndexed)
+            clientOrders.erase(pool[slot].clientOrderId, pool[slot].orderId);
+        pool.release(slot);
+    }
+
+    void reduceResting(int slot, int quantity, PriceLadder &side)
+    {
+        side.reduce(slot, quantity);
+        risk.changeOpen(pool[slot].account, -quantity);
+    }
+
+    void fillResting(int slot, int quantity, long long price, PriceLadder &side)
+    {
+        reduceResting(slot, quantity, side);
+        pool[slot].filledQuantity += quantity;
+        pool.filledNotional(slot) += price * quantity;
+    }
+
+    static OrderState stateOf(const OrderPool &orders, int slot, int type)
+    {
+        const RestingOrder &order = orders[slot];
+        OrderState state;
+        state.clientOrderId = order.clientOrderId;
+        state.orderId = order.orderId;
+        state.instrument = order.instrument;
+        state.side = order.side;
+        state.type = type;
+        state.price = order.price;
+        state.status = order.filledQuantity == 0 ? 0 : 3;
+        state.remainingQuantity = order.quantity;
+        state.filledQuantity = order.filledQuantity;
+        state.filledNotional = orders.filledNotional(slot);
+        return state;
+    }
+
+    int internAccount(std::string_view account)
+    {
+        if (account.empty())
+            return 0;
+        int accountId = accounts.intern(account);
+        if (accountId == accounts.size())
+            risk.addAccounts(accountId);
+        return accountId;
+    }
+
+    template <typename Output>
+    void emit(const ExecutionReport &report, Output &output)
+    {
+        latency.beginEmit();
+        writeExecutionReport(report, output);
+        latency.endEmit();
+    }
+
+    // Reports the incoming order itself with the given status and its
+    // remaining quantity.
+    template <typename Output>
+    void emitOrderStatus(const Order &order, int status, int reason, Output &output)
+    {
+        ExecutionReport executionReport;
+        executionReport.clientOrderId = order.clientOrderId;
+        executionReport.orderId = order.orderId;
+        executionReport.instrument = order.instrument;
+        executionReport.side = order.side;
+        executionReport.price = order.price;
+        executionReport.quantity = order.quantity;
+        executionReport.status = status;
+        executionReport.reason = reason;
+        emit(executionReport, output);
+    }
+
+    static ExecutionReport fillReport(std::string_view clientOrderId, int orderId, InstrumentType instrument, int side,
+                                      long long price, int quantity, int remaining)
+    {
+        ExecutionReport executionReport;
+        executionReport.clientOrderId = clientOrderId;
+        executionReport.orderId = orderId;
+        executionReport.instrument = instrument;
+        executionReport.side = side;
+        executionReport.price = price;
+        executionReport.quantity = quantity;
+        executionReport.status = remaining == 0 ? 2 : 3;
+        return executionReport;
+    }
+
+    // Reports quantity of an order as cancelled by self-trade prevention.
+    template <typename Output>
+    void emitSelfTradeCancel(std::string_view clientOrderId, int orderId, InstrumentType instrument, int side,
+                             long long price, int quantity, Output &output)
+    {
+        ExecutionReport executionReport = fillReport(clientOrderId, orderId, instrument, side, price, quantity, 0);
+        executionReport.status = 4;
+        emit(executionReport, output);
+    }
+
+    // Matching kernel for an incoming order on side Side. Returns the order's
+    // own outcome as a status code: New if it rests untouched, Fill or PFill,
+    // or Cancel or Expire for the unfilled part of an order that may not
+    // rest or that self-trade prevention cancelled. Market and triggered stop
+    // orders take any price. Each fill is reported buy side first, and so
+    // are the two cancels of a decrement.
+    template <typename Side, typename Output>
+    int matchOn(Order &order, InstrumentBook &orderBook, Output &output)
+    {
+        PriceLadder &ownSide = Side::own(orderBook);
+        PriceLadder &opposite = Side::opposite(orderBook);
+
+        bool anyPrice = order.type == ORDER_MARKET || order.type == ORDER_STOP;
+        long long limit = anyPrice ? Side::ANY_PRICE : order.price;
+        int account = order.accountId;
+        bool preventSelfTrade = account != 0 && selfTradePrevention != STP_NONE;
+        if (order.type == ORDER_FOK &&
+            opposite.quantityUpTo(limit, order.quantity, preventSelfTrade ? account : 0,
+                                  selfTradePrevention != STP_CANCEL_OLDEST) < order.quantity)
+        {
+            emitOrderStatus(order, 5, 0, output);
+            return 5;
+        }
+
+        bool matched = false;
+        int outcome = 0;
+        int filledQuantity = 0;
+        long long filledNotional = 0;
+        while (!opposite.empty() && order.quantity > 0 && Side::crosses(opposite.bestPrice(), limit))
+        {
+            int slot = opposite.bestLevel().head;
+            RestingOrder &resting = pool[slot];
+
+            if (preventSelfTrade && resting.account == account)
+            {
+                if (selfTradePrevention == STP_CANCEL_NEWEST)
+                {
+                    emitOrderStatus(order, 4, 0, output);
+                    return 4;
+                }
+                int cancelled = selfTradePrevention == STP_CANCEL_OLDEST ? resting.quantity
+                                                                          : std::min(order.quantity, resting.quantity);
+                if (selfTradePrevention == STP_DECREMENT_BOTH)
+                {
+                    order.quantity -= cancelled;
+                    outcome = 4;
+                    if constexpr (Side::SIDE == 1)
+                        emitSelfTradeCancel(order.clientOrderId, order.orderId, order.instrument, Side::SIDE,
+                                            order.price, cancelled, output);
+                }
+                emitSelfTradeCancel(resting.clientOrderId.view(), resting.orderId, resting.instrument, resting.side,
+                                    resting.price, cancelled, output);
+                if constexpr (Side::SIDE == 2)
+                {
+                    if (selfTradePrevention == STP_DECREMENT_BOTH)
+                        emitSelfTradeCancel(order.clientOrderId, order.orderId, order.instrument, Side::SIDE,
+                                            order.price, cancelled, output);
+                }
+                reduceResting(slot, cancelled, opposite);
+                if (resting.quantity == 0)
+                    unrest(slot, opposite);
+                continue;
+            }
+
+            matched = true;
+            int matchedQuantity = std::min(order.quantity, resting.quantity);
+            long long matchPrice = resting.price;
+            orderBook.noteTrade(matchPrice);
+            order.quantity -= matchedQuantity;
+            filledQuantity += matchedQuantity;
+            filledNotional += matchPrice * matchedQuantity;
+            fillResting(slot, matchedQuantity, matchPrice, opposite);
+            if (account != 0 || resting.account != 0)
+            {
+                if constexpr (Side::SIDE == 1)
+                    accounts.recordFill(account, resting.account, order.instrument, matchPrice, matchedQuantity);
+                else
+                    accounts.recordFill(resting.account, account, order.instrument, matchPrice, matchedQuantity);
+            }
+
+            if (tradeLog != nullptr)
+            {
+                if constexpr (Side::SIDE == 1)
+                    tradeLog->push_back(Trade{order.instrument, matchPrice, matchedQuantity, 1, order.orderId,
+                                              resting.orderId});
+                else
+                    tradeLog->push_back(Trade{order.instrument, matchPrice, matchedQuantity, 2, resting.orderId,
+                                              order.orderId});
+            }
+
+            ExecutionReport incomingReport = fillReport(order.clientOrderId, order.orderId, order.instrument, Side::SIDE,
+                                                        matchPrice, matchedQuantity, order.quantity);
+            ExecutionReport restingReport = fillReport(resting.clientOrderId.view(), resting.orderId, resting.instrument,
+                                                       resting.side, matchPrice, matchedQuantity, resting.quantity);
+            if constexpr (Side::SIDE == 1)
+            {
+                emit(incomingReport, output);
+                emit(restingReport, output);
+            }
+            else
+            {
+                emit(restingReport, output);
+                emit(incomingReport, output);
+            }
+            outcome = incomingReport.status;
+
+            if (resting.quantity == 0)
+                unrest(slot, opposite);
+        }
+
+        if (order.quantity > 0)
+        {
+            if (order.type != ORDER_LIMIT)
+            {
+                emitOrderStatus(order, 4, 0, output);
+                return 4;
+            }
+            if (!matched)
+                emitOrderStatus(order, 0, 0, output);
+            rest(order, ownSide, filledQuantity, filledNotional);
+            return matched ? 3 : 0;
+        }
+        return outcome;
+    }
+
+    template <typename Output>
+    int matchOrder(Order &order, Output &output)
+    {
+        InstrumentBook &orderBook = bookFor(order.instrument);
+        latency.lookedUp();
+        if (order.side == 1)
+            return matchOn<BuySide>(order, orderBook, output);
+        return matchOn<SellSide>(order, orderBook, output);
+    }
+
+    // Rests a limit order of the call phase without matching it, even if it
+    // crosses the book.
+    template <typename Output>
+    int collectOrder(Order &order, Output &output)
+    {
+        InstrumentBook &orderBook = bookFor(order.instrument);
+        latency.lookedUp();
+        emitOrderStatus(order, 0, 0, output);
+        rest(order, order.side == 1 ? orderBook.buySide : orderBook.sellSide);
+        return 0;
+    }
+
+    StopLadders &stopsFor(InstrumentBook &orderBook)
+    {
+        if (!orderBook.stops)
+        {
+            InstrumentType instrument = orderBook.buySide.instrumentType();
+            orderBook.stops.reset(new StopLadders(stopPool, universe->rules(instrument).band, instrument));
+        }
+        return *orderBook.stops;
+    }
+
+    void parkStop(const Order &order, InstrumentBook &orderBook)
+    {
+        StopLadders &stops = stopsFor(orderBook);
+        int slot = stopPool.allocate();
+        RestingOrder &stop = stopPool[slot];
+        stop.clientOrderId = SmallId(order.clientOrderId);
+        stop.price = order.price;
+        stop.orderId = order.orderId;
+        stop.quantity = order.quantity;
+        stop.side = order.side;
+        stop.instrument = order.instrument;
+        stop.account = order.accountId;
+        stop.filledQuantity = 0;
+        stopPool.filledNotional(slot) = 0;
+        (order.side == 1 ? stops.buyStops : stops.sellStops).add(slot);
+        stopOrders.insert(order.orderId, slot);
+        if (clientOrdersIndexed)
+            clientOrders.insert(stop.clientOrderId, order.orderId);
+        risk.changeOpen(order.accountId, order.quantity);
+    }
+
+    // A stop order whose price the last trade already reached runs at once;
+    // any other is reported New and waits for a trade that triggers it.
+    template <typename Output>
+    int placeStop(Order &order, Output &output)
+    {
+        InstrumentBook &orderBook = bookFor(order.instrument);
+        long long lastTrade = orderBook.lastTradePrice;
+        if (lastTrade != 0 && (order.side == 1 ? lastTrade >= order.price : lastTrade <= order.price))
+            return matchOrder(order, output);
+
+        latency.lookedUp();
+        emitOrderStatus(order, 0, 0, output);
+        parkStop(order, orderBook);
+        return 0;
+    }
+
+    // Runs, oldest first within a price, every stop order reached by a trade
+    // since the last check, including trades of the stops it runs. Only the
+    // best end of each stop ladder is looked at.
+    template <typename Output>
+    void triggerStops(InstrumentType instrument, Output &output)
+    {
+        InstrumentBook &orderBook = bookFor(instrument);
+        if (orderBook.stops)
+        {
+            PriceLadder &buyStops = orderBook.stops->buyStops;
+            PriceLadder &sellStops = orderBook.stops->sellStops;
+            for (;;)
+            {
+                PriceLadder *ladder;
+                if (!buyStops.empty() && orderBook.tradeHigh >= buyStops.bestPrice())
+                    ladder = &buyStops;
+                else if (!sellStops.empty() && orderBook.tradeLow <= sellStops.bestPrice())
+                    ladder = &sellStops;
+                else
+                    break;
+
+                int slot = ladder->bestLevel().head;
+                const RestingOrder &stop = stopPool[slot];
+                SmallId clientOrderId = stop.clientOrderId;
+                Order order;
+                order.clientOrderId = clientOrderId.view();
+                order.instrument = stop.instrument;
+                order.side = stop.side;
+                order.price = stop.price;
+                order.quantity = stop.quantity;
+                order.orderId = stop.orderId;
+                order.type = ORDER_STOP;
+                order.accountId = stop.account;
+                risk.changeOpen(stop.account, -stop.quantity);
+                ladder->remove(slot);
+                stopOrders.erase(stop.orderId);
+                if (clientOrdersIndexed)
+                    clientOrders.erase(stop.clientOrderId, stop.orderId);
+                stopPool.release(slot);
+                matchOrder(order, output);
+            }
+        }
+        orderBook.tradeHigh = 0;
+        orderBook.tradeLow = LLONG_MAX;
+    }
+
+    // Visits every price with orders from the best ask up to the best bid of
+    // a crossed book as (price, volume, surplus): the quantity that would
+    // trade there and the bids at or above it minus the asks at or below it.
+    // Both running totals are kept in the one pass over the levels.
+    template <typename Visit>
+    static void forEachCrossedPrice(const InstrumentBook &orderBook, Visit visit)
+    {
+        const PriceLadder &bids = orderBook.buySide;
+        const PriceLadder &asks = orderBook.sellSide;
+        if (bids.empty() || asks.empty() || bids.bestPrice() < asks.bestPrice())
+            return;
+        long long low = asks.bestPrice();
+        long long high = bids.bestPrice();
+        long long demand = 0;
+        for (long long price = low; price <= high; ++price)
+            demand += bids.quantityAt(price);
+        long long supply = 0;
+        for (long long price = low; price <= high; ++price)
+        {
+            int bid = bids.quantityAt(price);
+            int ask = asks.quantityAt(price);
+            supply += ask;
+            if (bid != 0 || ask != 0)
+                visit(price, std::min(demand, supply), demand - supply);
+            demand -= bid;
+        }
+    }
+
+    // The uncross price is the one that trades the most. Ties go to the
+    // smallest surplus, then to the highest price if the surplus is on the
+    // buy side at every tied price or the lowest if it is on the sell side,
+    // and otherwise to the price closest to the last trade (before the first
+    // trade, to the middle of the tied prices), the lower one if two are as
+    // close. Tied prices are always next to each other.
+    AuctionResult equilibrium(const InstrumentBook &orderBook) const
+    {
+        AuctionResult result;
+        long long low = 0;
+        long long high = 0;
+        bool buySurplus = false;
+        bool sellSurplus = false;
+        forEachCrossedPrice(orderBook, [&](long long price, long long volume, long long surplus)
+                            {
+            long long size = std::abs(surplus);
+            long long bestSize = std::abs(result.surplus);
+            if (volume > result.volume || (volume == result.volume && size < bestSize))
+            {
+                result = AuctionResult{price, volume, surplus};
+                low = price;
+                high = price;
+                buySurplus = surplus > 0;
+                sellSurplus = surplus < 0;
+            }
+            else if (volume == result.volume && size == bestSize)
+            {
+                high = price;
+                buySurplus = buySurplus || surplus > 0;
+                sellSurplus = sellSurplus || surplus < 0;
+            } });
+        if (result.volume == 0 || low == high)
+            return result;
+
+        long long target;
+        if (buySurplus && !sellSurplus)
+            target = high;
+        else if (sellSurplus && !buySurplus)
+            target = low;
+        else
+            target = orderBook.lastTradePrice != 0 ? orderBook.lastTradePrice : low + (high - low) / 2;
+        long long volume = result.volume;
+        long long size = std::abs(result.surplus);
+        forEachCrossedPrice(orderBook, [&](long long price, long long tiedVolume, long long surplus)
+                            {
+            if (tiedVolume == volume && std::abs(surplus) == size &&
+                std::abs(price - target) < std::abs(result.price - target))
+                result = AuctionResult{price, tiedVolume, surplus}; });
+        return result;
+    }
+
+    // Takes quantity off a resting order for self-trade prevention.
+    template <typename Output>
+    void cancelSelfTrade(int slot, int quantity, PriceLadder &side, Output &output)
+    {
+        RestingOrder &resting = pool[slot];
+        emitSelfTradeCancel(resting.clientOrderId.view(), resting.orderId, resting.instrument, resting.side,
+                            resting.price, quantity, output);
+        reduceResting(slot, quantity, side);
+        if (resting.quantity == 0)
+            unrest(slot, side);
+    }
+
+    // Fills every bid at or above the uncross price against every ask at or
+    // below it, in price-time order on both sides, at the one price. Each
+    // fill is reported buy side first. Two orders of one account meeting
+    // are handled by the self-trade prevention mode, with the newer order
+    // as the incoming one.
+    template <typename Output>
+    void uncrossBook(InstrumentBook &orderBook, Output &output)
+    {
+        AuctionResult result = equilibrium(orderBook);
+        if (result.volume == 0)
+            return;
+        long long price = result.price;
+        PriceLadder &bids = orderBook.buySide;
+        PriceLadder &asks = orderBook.sellSide;
+        while (!bids.empty() && !asks.empty() && bids.bestPrice() >= price && asks.bestPrice() <= price)
+        {
+            int buySlot = bids.bestLevel().head;
+            int sellSlot = asks.bestLevel().head;
+            RestingOrder &buy = pool[buySlot];
+            RestingOrder &sell = pool[sellSlot];
+
+            if (selfTradePrevention != STP_NONE && buy.account != 0 && buy.account == sell.account)
+            {
+                bool buyNewer = buy.orderId > sell.orderId;
+                int buyCancelled = 0;
+                int sellCancelled = 0;
+                if (selfTradePrevention == STP_DECREMENT_BOTH)
+                {
+                    buyCancelled = std::min(buy.quantity, sell.quantity);
+                    sellCancelled = buyCancelled;
+                }
+                else if (buyNewer == (selfTradePrevention == STP_CANCEL_NEWEST))
+                    buyCancelled = buy.quantity;
+                else
+                    sellCancelled = sell.quantity;
+                if (buyCancelled != 0)
+                    cancelSelfTrade(buySlot, buyCancelled, bids, output);
+                if (sellCancelled != 0)
+                    cancelSelfTrade(sellSlot, sellCancelled, asks, output);
+                continue;
+            }
+
+            int quantity = std::min(buy.quantity, sell.quantity);
+            orderBook.noteTrade(price);
+            fillResting(buySlot, quantity, price, bids);
+            fillResting(sellSlot, quantity, price, asks);
+            if (buy.account != 0 || sell.account != 0)
+                accounts.recordFill(buy.account, sell.account, buy.instrument, price, quantity);
+            if (tradeLog != nullptr)
+                tradeLog->push_back(Trade{buy.instrument, price, quantity, 0, buy.orderId, sell.orderId});
+            emit(fillReport(buy.clientOrderId.view(), buy.orderId, buy.instrument, 1, price, quantity, buy.quantity),
+                 output);
+            emit(fillReport(sell.clientOrderId.view(), sell.orderId, sell.instrument, 2, price, quantity,
+                            sell.quantity),
+                 output);
+            if (buy.quantity == 0)
+                unrest(buySlot, bids);
+            if (sell.quantity == 0)
+                unrest(sellSlot, asks);
+        }
+    }
+
+    // Ends the call phase: uncrosses every instrument in turn, then runs
+    // the stop orders the uncross prices reached.
+    template <typename Output>
+    void uncrossAll(Output &output)
+    {
+        callPhase = false;
+        for (std::unique_ptr<InstrumentBook> &orderBook : orderBooks)
+        {
+            if (orderBook)
+                uncrossBook(*orderBook, output);
+        }
+        for (std::unique_ptr<InstrumentBook> &orderBook : orderBooks)
+        {
+            if (orderBook)
+                triggerStops(orderBook->buySide.instrumentType(), output);
+        }
+    }
+
+    // Reference price of the price collar: the instrument's last trade, or
+    // before it has traded the best price on the other side; 0 if neither.
+    long long referencePrice(const Order &order) const
+    {
+        const InstrumentBook *orderBook = findBook(order.instrument);
+        if (orderBook == nullptr)
+            return 0;
+        if (orderBook->lastTradePrice != 0)
+            return orderBook->lastTradePrice;
+        const PriceLadder &opposite = order.side == 1 ? orderBook->sellSide : orderBook->buySide;
+        return opposite.empty() ? 0 : opposite.bestPrice();
+    }
+
+    // Returns the reject reason for an order outside the price collar or
+    // above the notional limit, or 0.
+    int checkPriceRisk(const Order &order) const
+    {
+        const RiskLimits &limits = risk.riskLimits();
+        if (limits.collarBasisPoints > 0 || limits.maxNotional > 0)
+        {
+            long long reference = referencePrice(order);
+            bool priced = order.type != ORDER_MARKET;
+            if (limits.collarBasisPoints > 0 && reference != 0 && priced && order.type != ORDER_STOP)
+            {
+                long long collar = reference * limits.collarBasisPoints / 10000;
+                if (order.price < reference - collar || order.price > reference + collar)
+                    return 8;
+            }
+            long long price = priced ? order.price : reference;
+            if (limits.maxNotional > 0 && price * order.quantity > limits.maxNotional)
+                return 9;
+        }
+        return 0;
+    }
+
+    // Returns the reject reason for an order that breaches a risk limit (see
+    // RiskLimits), or 0. Every check is a few reads of the book's counters.
+    int checkRisk(const Order &order) const
+    {
+        const RiskLimits &limits = risk.riskLimits();
+        int reason = checkPriceRisk(order);
+        if (reason != 0)
+            return reason;
+        if (order.accountId != 0 && limits.perAccount())
+            return risk.check(order.accountId, order.orderId, order.quantity);
+        return 0;
+    }
+
+    // Rejects the order if reason is set or it breaches a risk limit, and
+    // matches it otherwise.
+    template <typename Output>
+    void completeOrder(Order &order, int reason, Output &output)
+    {
+        advanceSession(order.orderId, output);
+        if (reason == 0)
+        {
+            if (order.accountId == 0)
+                order.accountId = internAccount(order.account);
+            reason = callPhase && order.type != ORDER_LIMIT ? 12 : checkRisk(order);
+        }
+        if (reason != 0)
+        {
+            emitOrderStatus(order, 1, reason, output);
+            latency.finish(order.instrument, 1);
+            return;
+        }
+
+        risk.recordOrder(order.accountId, order.orderId);
+        int outcome;
+        if (callPhase)
+            outcome = collectOrder(order, output);
+        else
+            outcome = order.type == ORDER_STOP ? placeStop(order, output) : matchOrder(order, output);
+        triggerStops(order.instrument, output);
+        latency.finish(order.instrument, outcome);
+    }
+
+public:
+    // The book trades the instruments of the universe in use when it is
+    // created.
+    OrderBook() : universe(&instrumentUniverse()), orderBooks(universe->size()) {}
+
+    // Logs every change to a level's total quantity into log, or stops
+    // logging for nullptr. The log is only ever appended to; whoever reads
+    // it clears it.
+    void logLevelChanges(std::vector<LevelChange> *log)
+    {
+        levelChanges = log;
+        for (std::unique_ptr<InstrumentBook> &orderBook : orderBooks)
+        {
+            if (!orderBook)
+                continue;
+            orderBook->buySide.logChanges(log);
+            orderBook->sellSide.logChanges(log);
+        }
+    }
+
+    // Logs every trade into log, or stops logging for nullptr. Like the
+    // level change log, whoever reads it clears it.
+    void logTrades(std::vector<Trade> *log)
+    {
+        tradeLog = log;
+    }
+
+    // Visits up to count levels of one side of an instrument's book, best
+    // first, as (price, total quantity).
+    template <typename Visit>
+    void forEachLevel(InstrumentType instrument, int side, int count, Visit visit) const
+    {
+        const InstrumentBook *orderBook = findBook(instrument);
+        if (orderBook == nullptr)
+            return;
+        (side == 1 ? orderBook->buySide : orderBook->sellSide).forEachLevel(count, visit);
+    }
+
+    // Preallocates storage for the given number of resting orders and the
+    // books of every instrument, so matching does not allocate until that many
+    // orders are resting at once. reserve(0) does nothing, so books are only
+    // built for instruments that trade.
+    void reserve(std::size_t orders)
+    {
+        if (orders == 0)
+            return;
+        pool.reserve(orders);
+        restingOrders.reserve(orders);
+        for (int i = 0; i < universe->size(); ++i)
+            bookFor(static_cast<InstrumentType>(i));
+    }
+
+    // Output is anything writeExecutionReport accepts: the report file in a
+    // serial run, or a shard's report queue in a sharded one.
+    template <typename Output>
+    void processOrder(Order &order, Output &output)
+    {
+        order.orderId = nextOrderId();
+        processNumberedOrder(order, output);
+    }
+
+    // Order IDs are numbered per book, starting at 1. Every order gets one,
+    // rejected ones included.
+    int nextOrderId()
+    {
+        return ++lastOrderId;
+    }
+
+    int lastAssignedOrderId() const
+    {
+        return lastOrderId;
+    }
+
+    // Continues numbering after orderId, e.g. after restoring a book.
+    void resumeOrderIds(int orderId)
+    {
+        if (orderId > lastOrderId)
+            lastOrderId = orderId;
+    }
+
+    // Sets the self-trade prevention mode (STP_NONE by default); orders
+    // without an account never count as self trades.
+    void setSelfTradePrevention(int mode)
+    {
+        selfTradePrevention = mode;
+    }
+
+    // Accounts seen so far and their positions, updated on every fill.
+    const AccountTable &accountTable() const
+    {
+        return accounts;
+    }
+
+    // Returns the account's number in this book, adding the account if it is
+    // new, or 0 for no account or a name too long to be valid. A caller that
+    // sees many orders of one account, such as a server connection, can look
+    // it up once and set Order::accountId, which saves the book the lookup.
+    int accountIdFor(std::string_view account)
+    {
+        return account.size() > ACCOUNT_CAPACITY ? 0 : internAccount(account);
+    }
+
+    // Sets an account's position, for rebuilding a book from a snapshot.
+    void restorePosition(std::string_view account, InstrumentType instrument, const Position &position)
+    {
+        if (!account.empty() && instrument != InstrumentType::Invalid)
+            accounts.position(internAccount(account), instrument) = position;
+    }
+
+    // Sets the pre-trade risk limits (all off by default). Orders already
+    // counted towards the order rate limit are forgotten; open quantities are
+    // counted again from the live orders.
+    void setRiskLimits(const RiskLimits &limits)
+    {
+        risk.setLimits(limits);
+        auto countOpen = [this](const RestingOrder &order)
+        {
+            risk.changeOpen(order.account, order.quantity);
+        };
+        forEachRestingOrder(countOpen);
+        forEachStopOrder(countOpen);
+    }
+
+    // Open quantities and order rate counters of the accounts, numbered like
+    // accountTable().
+    const AccountRisk &accountRisk() const
+    {
+        return risk;
+    }
+
+    // Counts an order towards its account's order rate limit again, for
+    // rebuilding a book from a snapshot; orders go oldest first.
+    void restoreRecentOrder(std::string_view account, int orderId)
+    {
+        if (!account.empty())
+            risk.recordOrder(internAccount(account), orderId);
+    }
+
+    // Runs the orders with IDs firstOrderId to lastOrderId, or to the end of
+    // the input for lastOrderId 0, as a call auction, e.g. for an opening or
+    // closing session. In the call phase limit orders rest without matching,
+    // even if the book crosses, and other order types are rejected; the
+    // first order after the window, or uncross at the end of the input,
+    // fills everything that crosses at one uncross price per instrument (see
+    // equilibrium) before continuous matching resumes. Windows go by order
+    // ID, like the order rate limit, so a replay and a run restored from the
+    // journal uncross at the same point. Windows must be added in order and
+    // must not overlap; returns false for one that does not fit.
+    bool scheduleAuction(int firstOrderId, int lastOrderId)
+    {
+        if (lastOrderId == 0)
+            lastOrderId = INT_MAX;
+        if (firstOrderId <= 0 || lastOrderId < firstOrderId ||
+            (!auctions.empty() && firstOrderId <= auctions.back().lastOrderId))
+            return false;
+        auctions.push_back(AuctionWindow{firstOrderId, lastOrderId});
+        return true;
+    }
+
+    bool inCallPhase() const
+    {
+        return callPhase;
+    }
+
+    // Moves the session on to the order with ID orderId: enters the call
+    // phase of its auction window, or uncrosses an auction whose window
+    // ended before it. Every processed order does this itself; the journal
+    // calls it for the IDs of orders it does not replay.
+    template <typename Output>
+    void advanceSession(int orderId, Output &output)
+    {
+        while (nextAuction < auctions.size())
+        {
+            const AuctionWindow &window = auctions[nextAuction];
+            if (orderId < window.firstOrderId)
+                return;
+            if (orderId <= window.lastOrderId)
+            {
+                callPhase = true;
+                return;
+            }
+            if (callPhase)
+                uncrossAll(output);
+            ++nextAuction;
+        }
+    }
+
+    // Uncrosses the auction now if the book is in a call phase, at the end
+    // of the input. Later orders of the same window start a new call phase.
+    template <typename Output>
+    void uncross(Output &output)
+    {
+        if (callPhase)
+            uncrossAll(output);
+    }
+
+    // The price, volume and surplus the instrument would uncross at now.
+    AuctionResult indicativeUncross(InstrumentType instrument) const
+    {
+        const InstrumentBook *orderBook = findBook(instrument);
+        return orderBook == nullptr ? AuctionResult() : equilibrium(*orderBook);
+    }
+
+    // Returns the reject reason for an order that fails the static checks,
+    // or 0 if it may be matched.
+    int validateOrder(const Order &order) const
+    {
+        if (order.clientOrderId.empty() || order.clientOrderId.length() > 7)
+            return 1;
+        if (order.instrument == InstrumentType::Invalid)
+            return 2;
+        if (order.side != 1 && order.side != 2)
+            return 3;
+        const InstrumentRules &rules = universe->rules(order.instrument);
+        if (order.type != ORDER_MARKET && !rules.validPrice(order.price))
+            return 4;
+        if (!rules.validQuantity(order.quantity))
+            return 5;
+        if (static_cast<unsigned>(order.type) >= static_cast<unsigned>(ORDER_TYPE_COUNT))
+            return 6;
+        if (order.account.size() > ACCOUNT_CAPACITY)
+            return 7;
+        return 0;
+    }
+
+    // Validates and matches an order whose ID has already been assigned.
+    template <typename Output>
+    void processNumberedOrder(Order &order, Output &output)
+    {
+        latency.begin();
+        int reason = validateOrder(order);
+        latency.validated();
+        completeOrder(order, reason, output);
+    }
+
+    // Rejects the order with the given reason, or matches it if the reason is
+    // 0, for orders that were validated in a batch.
+    template <typename Output>
+    void processValidatedOrder(Order &order, int reason, Output &output)
+    {
+        latency.begin();
+        latency.validated();
+        completeOrder(order, reason, output);
+    }
+
+    // Visits every resting order, instrument by instrument and oldest first
+    // within each price level, so restoring them in this order with
+    // restoreOrder rebuilds the same queues.
+    template <typename Visit>
+    void forEachRestingOrder(Visit visit) const
+    {
+        for (const std::unique_ptr<InstrumentBook> &orderBook : orderBooks)
+        {
+            if (!orderBook)
+                continue;
+            orderBook->buySide.forEachOrder(visit);
+            orderBook->sellSide.forEachOrder(visit);
+        }
+    }
+
+    // Visits every pending stop order the same way; their price is the
+    // trigger price.
+    template <typename Visit>
+    void forEachStopOrder(Visit visit) const
+    {
+        for (const std::unique_ptr<InstrumentBook> &orderBook : orderBooks)
+        {
+            if (!orderBook || !orderBook->stops)
+                continue;
+            orderBook->stops->buyStops.forEachOrder(visit);
+            orderBook->stops->sellStops.forEachOrder(visit);
+        }
+    }
+
+    // Price of the instrument's last trade, or 0 if it has not traded.
+    long long lastTradePrice(InstrumentType instrument) const
+    {
+        const InstrumentBook *orderBook = findBook(instrument);
+        return orderBook == nullptr ? 0 : orderBook->lastTradePrice;
+    }
+
+    void restoreLastTradePrice(InstrumentType instrument, long long price)
+    {
+        if (instrument != InstrumentType::Invalid)
+            bookFor(instrument).lastTradePrice = price;
+    }
+
+    // Puts an order back at the end of its level, or a stop order back among
+    // the pending stops, without matching it, for rebuilding a book from a
+    // snapshot. Returns false if the order could never have rested in this
+    // book.
+    bool restoreOrder(const Order &order)
+    {
+        if (validateOrder(order) != 0 || order.orderId <= 0 || restingOrders.find(order.orderId) >= 0 ||
+            stopOrders.find(order.orderId) >= 0)
+            return false;
+        InstrumentBook &orderBook = bookFor(order.instrument);
+        Order restored = order;
+        restored.accountId = internAccount(order.account);
+        if (order.type == ORDER_STOP)
+            parkStop(restored, orderBook);
+        else if (order.type == ORDER_LIMIT)
+            rest(restored, order.side == 1 ? orderBook.buySide : orderBook.sellSide);
+        else
+            return false;
+        return true;
+    }
+
+    // Adds fills to a resting order, for an order amended back into the
+    // book or rebuilt from a snapshot, which rests with none. Returns false
+    // if the order is not resting.
+    bool restoreFills(int orderId, int quantity, long long notional)
+    {
+        int slot = restingOrders.find(orderId);
+        if (slot < 0)
+            return false;
+        pool[slot].filledQuantity += quantity;
+        pool.filledNotional(slot) += notional;
+        return true;
+    }
+
+    // Looks up a live order, resting or a pending stop, by its order ID in
+    // constant time, without touching the book. Returns false if the order
+    // is not live: unknown, rejected, filled, cancelled or expired.
+    bool findOrder(int orderId, OrderState &state) const
+    {
+        int slot = restingOrders.find(orderId);
+        if (slot >= 0)
+        {
+            state = stateOf(pool, slot, ORDER_LIMIT);
+            return true;
+        }
+        slot = stopOrders.find(orderId);
+        if (slot >= 0)
+        {
+            state = stateOf(stopPool, slot, ORDER_STOP);
+            return true;
+        }
+        return false;
+    }
+
+    // Starts indexing live orders by client order ID, beginning with the
+    // ones live now, so forEachClientOrder can find them. The index costs a
+    // hash table update every time an order rests or leaves, so a book only
+    // keeps it once asked to.
+    void indexClientOrderIds()
+    {
+        if (clientOrdersIndexed)
+            return;
+        clientOrdersIndexed = true;
+        clientOrders.reserve(pool.capacity());
+        auto add = [this](const RestingOrder &order)
+        {
+            clientOrders.insert(order.clientOrderId, order.orderId);
+        };
+        forEachRestingOrder(add);
+        forEachStopOrder(add);
+    }
+
+    // Visits the state of every live order with the client order ID, in no
+    // particular order; nothing before indexClientOrderIds. Client order
+    // IDs are not checked for uniqueness, so there may be several.
+    template <typename Visit>
+    void forEachClientOrder(std::string_view clientOrderId, Visit visit) const
+    {
+        if (clientOrderId.empty() || clientOrderId.size() >= SmallId::CAPACITY)
+            return;
+        clientOrders.forEach(SmallId(clientOrderId), [&](int orderId)
+                             {
+            OrderState state;
+            if (findOrder(orderId, state))
+                visit(state); });
+    }
+
+    // Removes a resting order from its book. Returns false if the order is
+    // not resting (unknown, already filled or already cancelled); pending
+    // stop orders cannot be cancelled.
+    bool cancelOrder(int orderId)
+    {
+        int slot = restingOrders.find(orderId);
+        if (slot < 0)
+            return false;
+
+        unrest(slot, sideFor(pool[slot]));
+        return true;
+    }
+
+    // Changes the price and/or quantity of a resting order. Reducing the
+    // quantity at the same price keeps the order's place in the queue; any
+    // other change re-enters the order at the back of its new level, where it
+    // may match (outside the call phase) and is reported like a newly
+    // arrived order, after the same price collar, notional and open quantity
+    // checks as a new order. Returns 0 if the order was amended, -1 if it is
+    // not resting, or the reject reason that leaves it as it was: an invalid
+    // price or quantity, or a breached risk limit.
+    template <typename Output>
+    int amendOrder(int orderId, long long price, int quantity, Output &output)
+    {
+        int slot = restingOrders.find(orderId);
+        if (slot < 0)
+            return -1;
+        RestingOrder &resting = pool[slot];
+        const InstrumentRules &rules = universe->rules(resting.instrument);
+        if (!rules.validPrice(price))
+            return 4;
+        if (!rules.validQuantity(quantity))
+            return 5;
+
+        PriceLadder &side = sideFor(resting);
+        if (price == resting.price && quantity <= resting.quantity)
+        {
+            reduceResting(slot, resting.quantity - quantity, side);
+            return 0;
+        }
+
+        SmallId clientOrderId = resting.clientOrderId;
+        Order order;
+        order.clientOrderId = clientOrderId.view();
+        order.instrument = resting.instrument;
+        order.side = resting.side;
+        order.orderId = resting.orderId;
+        order.price = price;
+        order.quantity = quantity;
+        order.accountId = resting.account;
+        int reason = checkPriceRisk(order);
+        if (reason != 0)
+            return reason;
+        long long maxOpenQuantity = risk.riskLimits().maxOpenQuantity;
+        if (resting.account != 0 && maxOpenQuantity > 0 && quantity > resting.quantity &&
+            risk.open(resting.account) - resting.quantity + quantity > maxOpenQuantity)
+            return 10;
+
+        int filledQuantity = resting.filledQuantity;
+        long long filledNotional = pool.filledNotional(slot);
+        unrest(slot, side);
+
+        if (callPhase)
+        {
+            collectOrder(order, output);
+        }
+        else
+        {
+            matchOrder(order, output);
+            triggerStops(order.instrument, output);
+        }
+        restoreFills(order.orderId, filledQuantity, filledNotional);
+        return 0;
+    }
+};
+
+// Answers an order lookup. Its first character says what the rest is: '#'
+// and an order ID, with or without "ord", or '@' and a client order ID, so
+// a client order ID that looks like an order ID is still found. Writes the
+// state of each live order found, oldest first (see writeOrderState), a
+// NotFound line with the query if there is none, or an Invalid line for a
+// query of neither kind. Returns how many orders it found.
+inline std::size_t writeOrderQuery(const OrderBook &orderBook, std::string_view query, ReportWriter &output)
+{
+    std::vector<OrderState> found;
+    std::string_view key = query.empty() ? query : query.substr(1);
+    if (!query.empty() && query[0] == '#')
+    {
+        if (key.size() > 3 && key.compare(0, 3, "ord") == 0)
+            key.remove_prefix(3);
+        int orderId = 0;
+        const char *end = key.data() + key.size();
+        OrderState state;
+        if (!key.empty() && std::from_chars(key.data(), end, orderId).ptr == end &&
+            orderBook.findOrder(orderId, state))
+            found.push_back(state);
+    }
+    else if (!query.empty() && query[0] == '@')
+    {
+        orderBook.forEachClientOrder(key, [&](const OrderState &state)
+                                     { found.push_back(state); });
+        std::sort(found.begin(), found.end(), [](const OrderState &a, const OrderState &b)
+                  { return a.orderId < b.orderId; });
+    }
+    else
+    {
+        output.append("Invalid,").append(query).endRecord();
+        return 0;
+    }
+    for (const OrderState &state : found)
+        writeOrderState(state, output);
+    if (found.empty())
+        output.append("NotFound,").append(query).endRecord();
+    return found.size();
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "BinaryFormat.h"
+#include "Order.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+
+using namespace std;
+
+// Converts order files and execution report files between CSV and the binary
+// format in BinaryFormat.h. The direction is picked from the input file: a
+// binary input is written out as CSV and anything else is read as CSV.
+
+int statusFromString(string_view text)
+{
+    for (int status = 0; status < STATUS_COUNT; ++status)
+    {
+        if (text == statusToString(status))
+            return status;
+    }
+    return -1;
+}
+
+int reasonFromString(string_view text)
+{
+    for (int reason = 1; reason < REASON_COUNT; ++reason)
+    {
+        if (text == reasonToString(reason))
+            return reason;
+    }
+    return 0;
+}
+
+// Parses one execution_rep.csv row. Returns false for rows that do not look
+// like a report.
+bool parseReportLine(string_view line, ExecutionReport &report)
+{
+    string_view fields[8];
+    size_t count = 0;
+    size_t start = 0;
+    while (count < 8 && start <= line.size())
+    {
+        size_t end = line.find(',', start);
+        if (end == string_view::npos)
+            end = line.size();
+        fields[count++] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    if (count < 7 || fields[1].substr(0, 3) != "ord")
+        return false;
+
+    while (!fields[count - 1].empty() && fields[count - 1].back() == '\r')
+        fields[count - 1].remove_suffix(1);
+
+    report.clientOrderId = fields[0];
+    report.instrument = stringToInstrument(fields[2]);
+    report.status = statusFromString(fields[4]);
+    report.reason = count > 7 ? reasonFromString(fields[7]) : 0;
+    return report.status >= 0 &&
+           parseInt(fields[1].substr(3), report.orderId) &&
+           parseInt(fields[3], report.side) &&
+           parseInt(fields[5], report.quantity) &&
+           parsePrice(fields[6], report.price);
+}
+
+int convertOrders(const MappedFile &input, ReportWriter &output)
+{
+    Order order;
+    if (hasBinaryMagic(input.contents(), ORDER_FILE_MAGIC))
+    {
+        BinaryOrderReader orders;
+        if (!orders.open(input.contents()))
+        {
+            cerr << "Error: Unsupported binary order file" << endl;
+            return 1;
+        }
+        output.append("Cl. Ord. ID,Instrument,Side,Price,Quantity").endRecord();
+        while (orders.next(order))
+        {
+            output.append(order.clientOrderId).append(',')
+                .append(instrumentToString(order.instrument)).append(',')
+                .appendInt(order.side).append(',')
+                .appendFixed(order.price, PRICE_DECIMALS).append(',')
+                .appendInt(order.quantity);
+            if (order.type != ORDER_LIMIT || !order.account.empty())
+                output.append(',').append(order.type == ORDER_LIMIT ? "" : orderTypeToString(order.type));
+            if (!order.account.empty())
+                output.append(',').append(order.account);
+            output.endRecord();
+        }
+        return 0;
+    }
+
+    CsvOrderReader orders(input.contents());
+    writeBinaryHeader(output, ORDER_FILE_MAGIC, BINARY_ORDER_SIZE);
+    while (orders.next(order))
+        writeBinaryOrder(order, output);
+    return 0;
+}
+
+int convertReports(const MappedFile &input, ReportWriter &output)
+{
+    ExecutionReport report;
+    if (hasBinaryMagic(input.contents(), REPORT_FILE_MAGIC))
+    {
+        BinaryReportReader reports;
+        if (!reports.open(input.contents()))
+        {
+            cerr << "Error: Unsupported binary report file" << endl;
+            return 1;
+        }
+        output.append("Client Order ID,Order ID,Instrument,Side,Exec Status,Quantity,Price,Reason").endRecord();
+        while (reports.next(report))
+            writeExecutionReport(report, output);
+        return 0;
+    }
+
+    LineScanner lines(input.contents());
+    string_view line;
+    lines.next(line);
+
+    BinaryReportWriter reports(output);
+    while (lines.next(line))
+    {
+        if (!line.empty() && parseReportLine(line, report))
+            reports.write(report);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // Instruments are resolved against --instruments, the file main trades
+    // with, both in CSV files and in binary files' dictionaries.
+    if (argc == 6 && string(argv[1]) == "--instruments")
+    {
+        InstrumentUniverse universe;
+        size_t errorLine = 0;
+        if (!loadInstrumentUniverse(argv[2], universe, errorLine))
+        {
+            cerr << "Error: Invalid instrument file " << argv[2];
+            if (errorLine != 0)
+                cerr << " at line " << errorLine;
+            cerr << endl;
+            return 1;
+        }
+        instrumentUniverse() = move(universe);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 4 || (string(argv[1]) != "orders" && string(argv[1]) != "reports"))
+    {
+        cerr << "Usage: " << argv[0] << " [--instruments FILE] orders|reports INPUT OUTPUT" << endl;
+        return 1;
+    }
+
+    MappedFile input;
+    if (!input.open(argv[2]))
+    {
+        cerr << "Error: Could not open " << argv[2] << endl;
+        return 1;
+    }
+
+    ReportWriter output(argv[3]);
+    if (!output.is_open())
+    {
+        cerr << "Error: Could not open " << argv[3] << endl;
+        return 1;
+    }
+
+    if (string(argv[1]) == "orders")
+        return convertOrders(input, output);
+    return convertReports(input, output);
+}
@@ -0,0 +1,155 @@
+#ifndef ORDER_GENERATOR_H
+#define ORDER_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Order.h"
+#include "ReportWriter.h"
+
+struct GeneratorConfig
+{
+    std::uint64_t seed = 1;
+    std::size_t orders = 1000000;
+    // Relative share of each instrument, in instrument universe order; empty
+    // gives every instrument the same share.
+    std::vector<double> instrumentWeights;
+    long long startPrice = 50 * TICKS_PER_UNIT;
+    // Largest move of an instrument's mid price between two of its orders.
+    long long priceStep = 5;
+    // Passive orders are placed up to this many ticks behind the mid price;
+    // aggressive ones up to this many ticks through it.
+    long long priceDepth = 20;
+    double aggressiveRatio = 0.3;
+    double invalidRate = 0.02;
+    // Orders are spread evenly over this many accounts, named "acct1" and up,
+    // in the optional account column; 0 leaves the column out.
+    int accounts = 0;
+};
+
+// Seeded synthetic order flow in the orders.csv format. Every instrument's mid
+// price follows its own random walk; orders are priced around it either
+// passively (resting behind the mid) or aggressively (crossing it), and a
+// share of them break one of the validation rules. Random numbers come from
+// splitmix64 and are scaled by hand rather than through std distributions,
+// so a seed gives the same flow on every platform and standard library.
+class OrderGenerator
+{
+private:
+    GeneratorConfig config;
+    std::uint64_t state;
+    std::vector<long long> mids;
+    std::vector<double> cumulativeWeights;
+    std::size_t generated = 0;
+
+    // splitmix64
+    std::uint64_t nextRandom()
+    {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double nextUnit()
+    {
+        return static_cast<double>(nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    long long nextBetween(long long low, long long high)
+    {
+        return low + static_cast<long long>(nextRandom() % static_cast<std::uint64_t>(high - low + 1));
+    }
+
+    int nextInstrument()
+    {
+        double pick = nextUnit() * cumulativeWeights.back();
+        for (std::size_t i = 0; i < cumulativeWeights.size(); ++i)
+        {
+            if (pick < cumulativeWeights[i])
+                return static_cast<int>(i);
+        }
+        return static_cast<int>(cumulativeWeights.size()) - 1;
+    }
+
+public:
+    explicit OrderGenerator(const GeneratorConfig &generatorConfig)
+        : config(generatorConfig), state(generatorConfig.seed), mids(instrumentCount(), generatorConfig.startPrice)
+    {
+        double total = 0;
+        for (int i = 0; i < instrumentCount(); ++i)
+        {
+            total += i < static_cast<int>(config.instrumentWeights.size()) ? config.instrumentWeights[i] : 0.0;
+            cumulativeWeights.push_back(total);
+        }
+        if (total <= 0)
+        {
+            for (int i = 0; i < instrumentCount(); ++i)
+                cumulativeWeights[i] = i + 1;
+        }
+    }
+
+    // Appends the next order as one CSV row. Returns false once the
+    // configured number of orders has been generated.
+    bool next(ReportWriter &output)
+    {
+        if (generated == config.orders)
+            return false;
+        ++generated;
+
+        int instrument = nextInstrument();
+        long long &mid = mids[instrument];
+        mid += nextBetween(-config.priceStep, config.priceStep);
+        if (mid < config.priceDepth + 1)
+            mid = config.priceDepth + 1;
+
+        int side = static_cast<int>(nextBetween(1, 2));
+        bool aggressive = nextUnit() < config.aggressiveRatio;
+        long long offset = nextBetween(0, config.priceDepth);
+        bool throughMid = aggressive == (side == 1);
+        long long price = throughMid ? mid + offset : mid - offset;
+        const InstrumentRules &rules = rulesFor(static_cast<InstrumentType>(instrument));
+        long long quantity =
+            nextBetween((rules.minQuantity + rules.lotSize - 1) / rules.lotSize, rules.maxQuantity / rules.lotSize) *
+            rules.lotSize;
+
+        const char *idPrefix = "c";
+        std::string_view instrumentName = instrumentToString(static_cast<InstrumentType>(instrument));
+
+        if (nextUnit() < config.invalidRate)
+        {
+            switch (nextBetween(0, 4))
+            {
+            case 0:
+                idPrefix = "toolong";
+                break;
+            case 1:
+                instrumentName = "Daisy";
+                break;
+            case 2:
+                side = 3;
+                break;
+            case 3:
+                price = -price;
+                break;
+            default:
+                quantity += 5;
+                break;
+            }
+        }
+
+        output.append(idPrefix).appendInt(static_cast<long long>(generated % 1000000)).append(',')
+            .append(instrumentName).append(',')
+            .appendInt(side).append(',')
+            .appendFixed(price, PRICE_DECIMALS).append(',')
+            .appendInt(quantity);
+        if (config.accounts > 0)
+            output.append(",,acct").appendInt(nextBetween(1, config.accounts));
+        output.endRecord();
+        return true;
+    }
+};
+
+#endif
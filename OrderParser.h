@@ -0,0 +1,334 @@
+#ifndef ORDER_PARSER_H
+#define ORDER_PARSER_H
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FLOWER_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Order.h"
+
+// Read-only view of a whole input file. On POSIX systems the file is mapped
+// straight into memory; elsewhere it is read into a single buffer once.
+class MappedFile
+{
+private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+#ifdef FLOWER_HAVE_MMAP
+    bool mapped = false;
+#else
+    std::vector<char> buffer;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+#ifdef FLOWER_HAVE_MMAP
+        if (mapped)
+            munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    bool open(const char *path)
+    {
+#ifdef FLOWER_HAVE_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        size = static_cast<std::size_t>(info.st_size);
+        if (size > 0)
+        {
+            void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED)
+            {
+                close(fd);
+                return false;
+            }
+            madvise(address, size, MADV_SEQUENTIAL);
+            data = static_cast<const char *>(address);
+            mapped = true;
+        }
+        close(fd);
+        return true;
+#else
+        std::ifstream input(path, std::ios::binary);
+        if (!input.is_open())
+            return false;
+        buffer.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#endif
+    }
+
+    std::string_view contents() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+// Walks the lines of a buffer in place. Like getline, lines are split on '\n'
+// only and a final line without a newline is still returned.
+class LineScanner
+{
+private:
+    std::string_view text;
+    std::size_t position = 0;
+
+public:
+    explicit LineScanner(std::string_view text) : text(text) {}
+
+    bool next(std::string_view &line)
+    {
+        if (position >= text.size())
+            return false;
+
+        std::size_t end = text.find('\n', position);
+        if (end == std::string_view::npos)
+            end = text.size();
+        line = text.substr(position, end - position);
+        position = end + 1;
+        return true;
+    }
+};
+
+// Parses an int the way stoi does for well-formed input: leading whitespace
+// and a '+' sign are allowed and trailing characters are ignored. Returns
+// false when there is no number or it does not fit in an int.
+inline bool parseInt(std::string_view text, int &value)
+{
+    std::size_t i = 0;
+    while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+        ++i;
+    if (i < text.size() && text[i] == '+')
+    {
+        ++i;
+        if (i < text.size() && text[i] == '-')
+            return false;
+    }
+
+    std::from_chars_result result = std::from_chars(text.data() + i, text.data() + text.size(), value);
+    return result.ec == std::errc();
+}
+
+// Parses a decimal price straight into ticks, rounding half up to the
+// nearest tick. Like stod, leading whitespace is skipped and parsing stops at
+// the first character that cannot continue the number. Returns false when
+// there is no number or it does not fit.
+inline bool parsePrice(std::string_view text, long long &ticks)
+{
+    std::size_t i = 0;
+    while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+        ++i;
+
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+'))
+        negative = text[i++] == '-';
+
+    long long units = 0;
+    bool digits = false;
+    for (; i < text.size() && std::isdigit(static_cast<unsigned char>(text[i])); ++i)
+    {
+        if (units > 1000000000000LL)
+            return false;
+        units = units * 10 + (text[i] - '0');
+        digits = true;
+    }
+
+    long long fraction = 0;
+    long long scale = TICKS_PER_UNIT;
+    bool roundUp = false;
+    if (i < text.size() && text[i] == '.')
+    {
+        for (++i; i < text.size() && std::isdigit(static_cast<unsigned char>(text[i])); ++i)
+        {
+            if (scale > 1)
+            {
+                scale /= 10;
+                fraction += (text[i] - '0') * scale;
+            }
+            else if (scale == 1)
+            {
+                roundUp = text[i] >= '5';
+                scale = 0;
+            }
+            digits = true;
+        }
+    }
+    if (!digits)
+        return false;
+
+    ticks = units * TICKS_PER_UNIT + fraction + (roundUp ? 1 : 0);
+    if (negative)
+        ticks = -ticks;
+    return true;
+}
+
+inline std::string_view trimTrailingSpace(std::string_view text)
+{
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+        text.remove_suffix(1);
+    return text;
+}
+
+// Reads the optional order type column. An empty or missing column means a
+// limit order; a trailing '\r' or spaces are ignored.
+inline int parseOrderType(std::string_view text)
+{
+    text = trimTrailingSpace(text);
+    if (text.empty())
+        return ORDER_LIMIT;
+    return stringToOrderType(text);
+}
+
+// Fills order from one CSV row without allocating: the first five
+// comma-separated fields are used, then the optional order type and
+// client/account columns, and any further columns are ignored. Returns false
+// for rows that should be dropped, i.e. fewer than five fields or a side,
+// price or quantity that is not a number; the price of a market order may be
+// left empty.
+inline bool parseOrderLine(std::string_view line, Order &order)
+{
+    std::string_view fields[7];
+    std::size_t start = 0;
+    for (int i = 0; i < 7; ++i)
+    {
+        if (start > line.size())
+        {
+            if (i < 5)
+                return false;
+            break;
+        }
+        std::size_t end = line.find(',', start);
+        if (end == std::string_view::npos)
+            end = line.size();
+        fields[i] = line.substr(start, end - start);
+        start = end + 1;
+    }
+
+    order.clientOrderId = fields[0];
+    order.instrument = stringToInstrument(fields[1]);
+    order.type = parseOrderType(fields[5]);
+    order.account = trimTrailingSpace(fields[6]);
+    order.accountId = 0;
+    if (!parsePrice(fields[3], order.price))
+    {
+        if (order.type != ORDER_MARKET)
+            return false;
+        order.price = 0;
+    }
+    return parseInt(fields[2], order.side) &&
+           parseInt(fields[4], order.quantity);
+}
+
+// Reads orders from orders.csv text: the header line is skipped, and so are
+// empty lines and rows parseOrderLine drops.
+class CsvOrderReader
+{
+private:
+    LineScanner lines;
+
+public:
+    explicit CsvOrderReader(std::string_view text) : lines(text)
+    {
+        std::string_view header;
+        lines.next(header);
+    }
+
+    bool next(Order &order)
+    {
+        std::string_view line;
+        while (lines.next(line))
+        {
+            if (!line.empty() && parseOrderLine(line, order))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Loads an instrument universe from a CSV file with one instrument per row:
+//
+//   Instrument,Lot Size,Min Quantity,Max Quantity,Min Price,Max Price[,Tick Size]
+//
+// Prices and the tick size are decimal prices like in orders.csv; the tick
+// size defaults to 0.01. As in orders.csv the first line is a header; empty
+// lines and lines starting with '#' are skipped. Returns false if the file
+// cannot be read, lists no instruments or has an invalid row, whose line
+// number is then left in errorLine (0 if the file itself is the problem).
+inline bool loadInstrumentUniverse(const char *path, InstrumentUniverse &universe, std::size_t &errorLine)
+{
+    errorLine = 0;
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    LineScanner lines(file.contents());
+    std::string_view line;
+    lines.next(line);
+    std::size_t lineNumber = 1;
+    while (lines.next(line))
+    {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::string_view fields[7];
+        std::size_t fieldCount = 0;
+        std::size_t start = 0;
+        while (fieldCount < 7 && start <= line.size())
+        {
+            std::size_t end = line.find(',', start);
+            if (end == std::string_view::npos)
+                end = line.size();
+            fields[fieldCount++] = line.substr(start, end - start);
+            start = end + 1;
+        }
+
+        InstrumentRules rules;
+        errorLine = lineNumber;
+        if (fieldCount < 6 || !parseInt(fields[1], rules.lotSize) || !parseInt(fields[2], rules.minQuantity) ||
+            !parseInt(fields[3], rules.maxQuantity) || !parsePrice(fields[4], rules.band.minTick) ||
+            !parsePrice(fields[5], rules.band.maxTick) || (fieldCount > 6 && !parsePrice(fields[6], rules.tickSize)))
+            return false;
+        if (rules.lotSize < 1 || rules.minQuantity < 1 || rules.maxQuantity < rules.minQuantity ||
+            rules.band.minTick < 1 || rules.band.maxTick < rules.band.minTick || rules.tickSize < 1)
+            return false;
+        if (!universe.add(fields[0], rules))
+            return false;
+    }
+    errorLine = 0;
+    if (universe.size() == 0)
+        return false;
+    universe.finish();
+    return true;
+}
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef ORDER_POOL_H
+#define ORDER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Order.h"
+
+// An order resting in a book. Orders at one price level are chained through
+// previous/next slot indexes, oldest first. quantity is what is left of the
+// order and filledQuantity how much of it has filled so far.
+struct RestingOrder
+{
+    SmallId clientOrderId;
+    long long price;
+    int orderId;
+    int quantity;
+    int side;
+    InstrumentType instrument;
+    // AccountTable number of the order's account, 0 for none.
+    int account;
+    int previous;
+    int next;
+    int filledQuantity;
+};
+
+// Slab of resting orders referenced by index. Released slots are chained into
+// a free list and reused, so once the pool has grown to the peak number of
+// resting orders it never allocates again.
+//
+// Each slot's fill notional (price times quantity of the order's fills so
+// far, in ticks) is kept apart from the slot, which would otherwise grow
+// from 48 to 64 bytes and slow down every walk of the price levels.
+class OrderPool
+{
+private:
+    std::vector<RestingOrder> slots;
+    std::vector<long long> notionals;
+    int freeHead = -1;
+
+public:
+    void reserve(std::size_t capacity)
+    {
+        slots.reserve(capacity);
+        notionals.reserve(capacity);
+    }
+
+    std::size_t capacity() const
+    {
+        return slots.capacity();
+    }
+
+    int allocate()
+    {
+        if (freeHead < 0)
+        {
+            slots.emplace_back();
+            notionals.emplace_back();
+            return static_cast<int>(slots.size() - 1);
+        }
+        int slot = freeHead;
+        freeHead = slots[slot].next;
+        return slot;
+    }
+
+    void release(int slot)
+    {
+        slots[slot].next = freeHead;
+        freeHead = slot;
+    }
+
+    RestingOrder &operator[](int slot)
+    {
+        return slots[slot];
+    }
+
+    const RestingOrder &operator[](int slot) const
+    {
+        return slots[slot];
+    }
+
+    long long &filledNotional(int slot)
+    {
+        return notionals[slot];
+    }
+
+    long long filledNotional(int slot) const
+    {
+        return notionals[slot];
+    }
+};
+
+// Maps order IDs of resting orders to their pool slots. Open addressing with
+// linear probing, kept at most half full; it only reallocates when the number
+// of resting orders reaches a new peak.
+class OrderIndex
+{
+private:
+    struct Entry
+    {
+        int orderId = 0;
+        int slot = -1;
+    };
+
+    std::vector<Entry> entries;
+    std::size_t mask = 0;
+    std::size_t count = 0;
+
+    std::size_t home(int orderId) const
+    {
+        return (static_cast<std::uint32_t>(orderId) * 2654435761u) & mask;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<Entry> old;
+        old.swap(entries);
+        entries.resize(capacity);
+        mask = capacity - 1;
+        count = 0;
+        for (const Entry &entry : old)
+        {
+            if (entry.orderId != 0)
+                insert(entry.orderId, entry.slot);
+        }
+    }
+
+public:
+    OrderIndex()
+    {
+        rehash(1024);
+    }
+
+    void reserve(std::size_t orders)
+    {
+        std::size_t capacity = entries.size();
+        while (capacity < orders * 2)
+            capacity <<= 1;
+        if (capacity != entries.size())
+            rehash(capacity);
+    }
+
+    // Order IDs start at 1; 0 marks an empty entry.
+    void insert(int orderId, int slot)
+    {
+        if ((count + 1) * 2 > entries.size())
+            rehash(entries.size() * 2);
+
+        std::size_t i = home(orderId);
+        while (entries[i].orderId != 0 && entries[i].orderId != orderId)
+            i = (i + 1) & mask;
+        if (entries[i].orderId == 0)
+            ++count;
+        entries[i].orderId = orderId;
+        entries[i].slot = slot;
+    }
+
+    // Returns the slot of a resting order, or -1.
+    int find(int orderId) const
+    {
+        for (std::size_t i = home(orderId); entries[i].orderId != 0; i = (i + 1) & mask)
+        {
+            if (entries[i].orderId == orderId)
+                return entries[i].slot;
+        }
+        return -1;
+    }
+
+    void erase(int orderId)
+    {
+        std::size_t i = home(orderId);
+        while (entries[i].orderId != orderId)
+        {
+            if (entries[i].orderId == 0)
+                return;
+            i = (i + 1) & mask;
+        }
+
+        // Shift later entries of the probe run back so lookups never need
+        // tombstones.
+        std::size_t j = i;
+        for (;;)
+        {
+            j = (j + 1) & mask;
+            if (entries[j].orderId == 0)
+                break;
+            std::size_t k = home(entries[j].orderId);
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays)
+            {
+                entries[i] = entries[j];
+                i = j;
+            }
+        }
+        entries[i] = Entry();
+        --count;
+    }
+};
+
+// Maps the client order IDs of live orders to their order IDs. Client order
+// IDs need not be unique, so each order is an entry of its own; the entries
+// of one ID all sit in its probe run. Otherwise like OrderIndex: linear
+// probing, at most half full, no tombstones.
+class ClientOrderIndex
+{
+private:
+    struct Entry
+    {
+        // The ID's 8 bytes; IDs are never empty, so 0 marks an empty entry.
+        std::uint64_t key = 0;
+        int orderId = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::size_t mask = 0;
+    std::size_t count = 0;
+
+    static std::uint64_t keyOf(const SmallId &clientOrderId)
+    {
+        std::uint64_t key;
+        std::memcpy(&key, clientOrderId.text, sizeof(key));
+        return key;
+    }
+
+    std::size_t home(std::uint64_t key) const
+    {
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<Entry> old;
+        old.swap(entries);
+        entries.resize(capacity);
+        mask = capacity - 1;
+        count = 0;
+        for (const Entry &entry : old)
+        {
+            if (entry.key != 0)
+                add(entry);
+        }
+    }
+
+    void add(const Entry &entry)
+    {
+        if ((count + 1) * 2 > entries.size())
+            rehash(entries.size() * 2);
+        std::size_t i = home(entry.key);
+        while (entries[i].key != 0)
+            i = (i + 1) & mask;
+        entries[i] = entry;
+        ++count;
+    }
+
+public:
+    ClientOrderIndex()
+    {
+        rehash(1024);
+    }
+
+    void reserve(std::size_t orders)
+    {
+        std::size_t capacity = entries.size();
+        while (capacity < orders * 2)
+            capacity <<= 1;
+        if (capacity != entries.size())
+            rehash(capacity);
+    }
+
+    void insert(const SmallId &clientOrderId, int orderId)
+    {
+        Entry entry;
+        entry.key = keyOf(clientOrderId);
+        entry.orderId = orderId;
+        add(entry);
+    }
+
+    // Visits the order ID of every order with the client order ID, in no
+    // particular order.
+    template <typename Visit>
+    void forEach(const SmallId &clientOrderId, Visit visit) const
+    {
+        std::uint64_t key = keyOf(clientOrderId);
+        for (std::size_t i = home(key); entries[i].key != 0; i = (i + 1) & mask)
+        {
+            if (entries[i].key == key)
+                visit(entries[i].orderId);
+        }
+    }
+
+    void erase(const SmallId &clientOrderId, int orderId)
+    {
+        std::uint64_t key = keyOf(clientOrderId);
+        std::size_t i = home(key);
+        while (entries[i].key != key || entries[i].orderId != orderId)
+        {
+            if (entries[i].key == 0)
+                return;
+            i = (i + 1) & mask;
+        }
+
+        std::size_t j = i;
+        for (;;)
+        {
+            j = (j + 1) & mask;
+            if (entries[j].key == 0)
+                break;
+            std::size_t k = home(entries[j].key);
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays)
+            {
+                entries[i] = entries[j];
+                i = j;
+            }
+        }
+        entries[i] = Entry();
+        --count;
+    }
+};
+
+#endif
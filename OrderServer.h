@@ -0,0 +1,499 @@
+#ifndef ORDER_SERVER_H
+#define ORDER_SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#define FLOWER_HAVE_EPOLL
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+#include "ThreadPlacement.h"
+
+struct ServerOptions
+{
+    // Port on 127.0.0.1, 0 for any free port, -1 for none.
+    int tcpPort = -1;
+    std::string unixPath;
+    bool useStdin = false;
+    // Most bytes read from one connection per wakeup, so a busy client
+    // cannot starve the others.
+    std::size_t batchBytes = 64 * 1024;
+    // How the loop waits for input: blocking in epoll_wait, or polling it
+    // and yielding or spinning between polls.
+    int waitMode = WAIT_BLOCK;
+};
+
+#ifdef FLOWER_HAVE_EPOLL
+
+inline volatile std::sig_atomic_t serverStopRequested = 0;
+
+inline void requestServerStop(int)
+{
+    serverStopRequested = 1;
+}
+
+// Long-running order gateway. Order lines in the orders.csv format arrive
+// over local TCP, a Unix domain socket or stdin; each wakeup of the epoll
+// loop reads what the ready connections have sent and matches every complete
+// line in one batch. Execution reports go back, in the execution_rep.csv
+// format, to the connection that sent the order, including fills of orders
+// that were resting in the book; reports for a connection that has gone
+// away are dropped. Stdin's reports are written to stdout.
+//
+// A line of '?' and an order lookup, e.g. "?#42" or "?@aa13", is not an
+// order: it is answered on the same connection with the current state of
+// the live orders it finds (see writeOrderQuery), in line with the reports.
+//
+// Clients that stop reading get no more of their input read once MAX_PENDING
+// bytes of reports are waiting for them.
+class OrderServer
+{
+private:
+    static const std::size_t MAX_PENDING = 16 << 20;
+    static const std::size_t MAX_LINE = 4096;
+    static const int MAX_EVENTS = 64;
+
+    struct Connection
+    {
+        std::uint64_t id = 0;
+        int inFd = -1;
+        int outFd = -1;
+        bool listening = false;
+        bool closing = false;
+        std::uint32_t events = 0;
+        std::string input;
+        std::string pending;
+        std::size_t written = 0;
+        std::unique_ptr<ReportWriter> reports;
+        // The account of the connection's last order and its number in the
+        // book; a client usually trades for one account, so the book's
+        // account lookup runs once per connection rather than per order.
+        std::string account;
+        int accountId = 0;
+    };
+
+    OrderBook &orderBook;
+    ServerOptions options;
+    int epollFd = -1;
+    std::uint64_t nextId = 1;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Connection>> connections;
+    // Connection that sent each resting order.
+    std::unordered_map<int, std::uint64_t> owners;
+    Connection *current = nullptr;
+    int currentOrderId = 0;
+    // Owned orders that got a Cancel or Expire while the current order was
+    // matched. A self-trade cancel can take only part of an order, so
+    // whether one is still live is only known once matching is done.
+    std::vector<int> cancelledOrders;
+    std::size_t ordersProcessed = 0;
+    std::size_t connectionsAccepted = 0;
+    std::size_t queriesAnswered = 0;
+
+    static bool setNonBlocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    Connection *addConnection(int inFd, int outFd, bool listening)
+    {
+        std::unique_ptr<Connection> connection = std::make_unique<Connection>();
+        connection->id = nextId++;
+        connection->inFd = inFd;
+        connection->outFd = outFd;
+        connection->listening = listening;
+        connection->events = EPOLLIN;
+        if (!listening)
+            connection->reports = std::make_unique<ReportWriter>(connection->pending, 64 * 1024);
+
+        epoll_event event = {};
+        event.events = connection->events;
+        event.data.u64 = connection->id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, inFd, &event) != 0)
+            return nullptr;
+        Connection *added = connection.get();
+        connections.emplace(added->id, std::move(connection));
+        return added;
+    }
+
+    void closeConnection(Connection &connection)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.inFd, nullptr);
+        if (connection.inFd > STDERR_FILENO)
+            ::close(connection.inFd);
+        connections.erase(connection.id);
+    }
+
+    bool listenTcp(int port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(port));
+        socklen_t length = sizeof(address);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0 ||
+            !setNonBlocking(fd) || getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0 ||
+            addConnection(fd, fd, true) == nullptr)
+        {
+            ::close(fd);
+            return false;
+        }
+        std::cerr << "Listening on 127.0.0.1:" << ntohs(address.sin_port) << std::endl;
+        return true;
+    }
+
+    bool listenUnix(const std::string &path)
+    {
+        sockaddr_un address = {};
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        unlink(path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0 ||
+            !setNonBlocking(fd) || addConnection(fd, fd, true) == nullptr)
+        {
+            ::close(fd);
+            return false;
+        }
+        std::cerr << "Listening on " << path << std::endl;
+        return true;
+    }
+
+    void accept(Connection &listener)
+    {
+        for (;;)
+        {
+            int fd = ::accept(listener.inFd, nullptr, nullptr);
+            if (fd < 0)
+                return;
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            if (!setNonBlocking(fd) || addConnection(fd, fd, false) == nullptr)
+            {
+                ::close(fd);
+                continue;
+            }
+            ++connectionsAccepted;
+        }
+    }
+
+    // Reads one batch from a connection and matches every complete line in
+    // it. At end of input a final line without a newline is matched too.
+    void read(Connection &connection)
+    {
+        std::size_t start = connection.input.size();
+        connection.input.resize(start + options.batchBytes);
+        ssize_t count = ::read(connection.inFd, &connection.input[start], options.batchBytes);
+        connection.input.resize(start + (count > 0 ? count : 0));
+        if (count < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        bool ended = count <= 0;
+
+        // Order client IDs point into the input buffer, which stays put until
+        // every order in it has been processed.
+        std::string_view text = connection.input;
+        std::size_t consumed = 0;
+        current = &connection;
+        for (;;)
+        {
+            std::size_t end = text.find('\n', consumed);
+            if (end == std::string_view::npos)
+            {
+                if (!ended || consumed == text.size())
+                    break;
+                end = text.size();
+            }
+            processLine(text.substr(consumed, end - consumed));
+            consumed = end < text.size() ? end + 1 : end;
+        }
+        current = nullptr;
+        connection.input.erase(0, consumed);
+
+        if (!ended && connection.input.size() > MAX_LINE)
+        {
+            // An error line, sent ahead of the close, tells the client this
+            // was its own protocol error rather than the server going away.
+            std::string error = "Line over " + std::to_string(MAX_LINE) + " bytes";
+            connection.reports->append("Error,").append(error).endRecord();
+            std::cerr << "Warning: Closing connection " << connection.id << ": " << error << std::endl;
+        }
+        if (ended || connection.input.size() > MAX_LINE)
+            connection.closing = true;
+    }
+
+    void processLine(std::string_view line)
+    {
+        if (!line.empty() && line[0] == '?')
+        {
+            std::string_view query = line.substr(1);
+            if (!query.empty() && query.back() == '\r')
+                query.remove_suffix(1);
+            writeOrderQuery(orderBook, query, *current->reports);
+            ++queriesAnswered;
+            return;
+        }
+        Order order;
+        if (line.empty() || !parseOrderLine(line, order))
+            return;
+        if (!order.account.empty())
+        {
+            if (order.account != current->account)
+            {
+                current->account = order.account;
+                current->accountId = orderBook.accountIdFor(order.account);
+            }
+            order.accountId = current->accountId;
+        }
+        order.orderId = orderBook.nextOrderId();
+        currentOrderId = order.orderId;
+        orderBook.processNumberedOrder(order, *this);
+        // The book, not the order's last report, says whether it is left
+        // resting or as a pending stop: a self-trade cancel can follow a
+        // partial fill of an order that still rests.
+        OrderState state;
+        if (orderBook.findOrder(order.orderId, state))
+            owners[order.orderId] = current->id;
+        for (int orderId : cancelledOrders)
+        {
+            if (!orderBook.findOrder(orderId, state))
+                owners.erase(orderId);
+        }
+        cancelledOrders.clear();
+        ++ordersProcessed;
+    }
+
+    // Sends as much pending output as the connection takes without blocking.
+    // Returns false if the connection failed.
+    bool write(Connection &connection)
+    {
+        connection.reports->flush();
+        while (connection.written < connection.pending.size())
+        {
+            ssize_t count = ::write(connection.outFd, connection.pending.data() + connection.written,
+                                    connection.pending.size() - connection.written);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN;
+            }
+            connection.written += count;
+        }
+        if (connection.written == connection.pending.size())
+        {
+            connection.pending.clear();
+            connection.written = 0;
+        }
+        else if (connection.written > connection.pending.size() / 2)
+        {
+            connection.pending.erase(0, connection.written);
+            connection.written = 0;
+        }
+        return true;
+    }
+
+    // Writes the connection's reports and updates what epoll waits for:
+    // input while the connection is open and not too far behind on reading
+    // its reports, and room to write while reports are pending. Stdin's
+    // reports go to stdout, which is written blocking.
+    void update(Connection &connection)
+    {
+        if (!write(connection))
+        {
+            closeConnection(connection);
+            return;
+        }
+        std::size_t pending = connection.pending.size() - connection.written;
+        if (connection.closing && pending == 0)
+        {
+            closeConnection(connection);
+            return;
+        }
+
+        bool socket = connection.inFd == connection.outFd;
+        std::uint32_t events = 0;
+        if (!connection.closing && pending < MAX_PENDING)
+            events |= EPOLLIN;
+        if (socket && pending > 0)
+            events |= EPOLLOUT;
+        if (events != connection.events)
+        {
+            epoll_event event = {};
+            event.events = events;
+            event.data.u64 = connection.id;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.inFd, &event);
+            connection.events = events;
+        }
+    }
+
+    // The incoming order's reports go to the connection being read, the
+    // others to the connection that sent the resting order.
+    void route(const ExecutionReport &report)
+    {
+        Connection *connection = nullptr;
+        if (report.orderId == currentOrderId)
+            connection = current;
+        else
+        {
+            auto owner = owners.find(report.orderId);
+            if (owner == owners.end())
+                return;
+            auto it = connections.find(owner->second);
+            if (it != connections.end())
+                connection = it->second.get();
+            if (report.status == 2)
+                owners.erase(owner);
+            else if (report.status == 4 || report.status == 5)
+                cancelledOrders.push_back(report.orderId);
+        }
+        if (connection != nullptr)
+            writeExecutionReport(report, *connection->reports);
+    }
+
+    // Lets the server itself be the report sink for OrderBook.
+    friend void writeExecutionReport(const ExecutionReport &report, OrderServer &server)
+    {
+        server.route(report);
+    }
+
+public:
+    OrderServer(OrderBook &orderBook, const ServerOptions &options) : orderBook(orderBook), options(options)
+    {
+        orderBook.indexClientOrderIds();
+    }
+
+    OrderServer(const OrderServer &) = delete;
+    OrderServer &operator=(const OrderServer &) = delete;
+
+    ~OrderServer()
+    {
+        for (auto &entry : connections)
+        {
+            if (entry.second->inFd > STDERR_FILENO)
+                ::close(entry.second->inFd);
+        }
+        if (!options.unixPath.empty())
+            unlink(options.unixPath.c_str());
+        if (epollFd >= 0)
+            ::close(epollFd);
+    }
+
+    // Sets up the listeners. Returns false if any of them failed.
+    bool open()
+    {
+        epollFd = epoll_create1(0);
+        if (epollFd < 0)
+            return false;
+        signal(SIGPIPE, SIG_IGN);
+
+        if (options.tcpPort >= 0 && !listenTcp(options.tcpPort))
+        {
+            std::cerr << "Error: Could not listen on port " << options.tcpPort << std::endl;
+            return false;
+        }
+        if (!options.unixPath.empty() && !listenUnix(options.unixPath))
+        {
+            std::cerr << "Error: Could not listen on " << options.unixPath << std::endl;
+            return false;
+        }
+        if (options.useStdin && addConnection(STDIN_FILENO, STDOUT_FILENO, false) == nullptr)
+        {
+            std::cerr << "Error: stdin must be a pipe or terminal in server mode" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Runs until SIGINT or SIGTERM, or, with only stdin to serve, until
+    // stdin ends.
+    void run()
+    {
+        struct sigaction action = {};
+        action.sa_handler = requestServerStop;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        epoll_event events[MAX_EVENTS];
+        int timeout = options.waitMode == WAIT_BLOCK ? -1 : 0;
+        while (!serverStopRequested && !connections.empty())
+        {
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (count == 0)
+            {
+                if (options.waitMode == WAIT_SPIN)
+                    cpuRelax();
+                else
+                    std::this_thread::yield();
+                continue;
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                auto it = connections.find(events[i].data.u64);
+                if (it == connections.end())
+                    continue;
+                Connection &connection = *it->second;
+                if (connection.listening)
+                    accept(connection);
+                else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read(connection);
+            }
+
+            // Reports of one batch can go to any connection with resting
+            // orders, so every connection with output is updated.
+            for (auto it = connections.begin(); it != connections.end();)
+            {
+                Connection &connection = *it->second;
+                ++it;
+                if (!connection.listening)
+                    update(connection);
+            }
+        }
+        std::cerr << "Served " << connectionsAccepted << " connections, " << ordersProcessed << " orders, "
+                  << queriesAnswered << " queries" << std::endl;
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PRE_TRADE_RISK_H
+#define PRE_TRADE_RISK_H
+
+#include <cstddef>
+#include <vector>
+
+// Pre-trade risk limits, checked after the static field checks and before an
+// order is matched. Every limit is off at 0.
+//
+// The price collar rejects a priced order more than collarBasisPoints away
+// from the instrument's reference price: its last trade, or the best price on
+// the other side of the book before it has traded. Market orders have no
+// price to collar, and a stop order's price is only a trigger.
+//
+// maxNotional caps price times quantity of one order, in ticks like
+// Position::notional; a market order is valued at the reference price.
+//
+// The per-account limits apply to orders with an account: maxOpenQuantity
+// caps the quantity an account has resting and pending in stop orders,
+// counting the new order in full, and maxOrders caps the orders an account
+// may enter within any rateWindow consecutive order IDs. The order ID
+// sequence stands in for time, so a replay and a run restored from the
+// journal take the same decisions as the original run.
+struct RiskLimits
+{
+    long long collarBasisPoints = 0;
+    long long maxNotional = 0;
+    long long maxOpenQuantity = 0;
+    int maxOrders = 0;
+    int rateWindow = 0;
+
+    bool perAccount() const
+    {
+        return maxOpenQuantity > 0 || (maxOrders > 0 && rateWindow > 0);
+    }
+};
+
+// Per-account counters for the per-account limits, indexed by the account
+// numbers of an AccountTable. Each account has its open quantity and a ring
+// of the order IDs of its last maxOrders accepted orders; an order passes the
+// rate limit if the oldest of them is at least rateWindow IDs back. Counters
+// are added when an account first shows up, so checking and booking an order
+// never allocates. Open quantities are only kept while the open quantity
+// limit is on, so resting and filling orders costs nothing without it.
+class AccountRisk
+{
+private:
+    RiskLimits limits;
+    std::vector<long long> openQuantity;
+    std::vector<int> recentOrders;
+    std::vector<int> ringHeads;
+
+public:
+    void setLimits(const RiskLimits &riskLimits)
+    {
+        limits = riskLimits;
+        std::size_t accounts = openQuantity.size();
+        openQuantity.assign(accounts, 0);
+        recentOrders.assign(accounts * static_cast<std::size_t>(limits.maxOrders), 0);
+        ringHeads.assign(accounts, 0);
+    }
+
+    const RiskLimits &riskLimits() const
+    {
+        return limits;
+    }
+
+    // Makes room for accounts numbered up to accountCount.
+    void addAccounts(int accountCount)
+    {
+        std::size_t accounts = static_cast<std::size_t>(accountCount);
+        if (accounts <= openQuantity.size())
+            return;
+        openQuantity.resize(accounts, 0);
+        recentOrders.resize(accounts * static_cast<std::size_t>(limits.maxOrders), 0);
+        ringHeads.resize(accounts, 0);
+    }
+
+    // account must not be 0.
+    long long open(int account) const
+    {
+        return openQuantity[account - 1];
+    }
+
+    // Adds quantity, which may be negative, to the account's open quantity;
+    // account 0 is not tracked, and nothing is without the limit.
+    void changeOpen(int account, long long quantity)
+    {
+        if (account != 0 && limits.maxOpenQuantity > 0)
+            openQuantity[account - 1] += quantity;
+    }
+
+    // Returns the reject reason if an order of quantity with ID orderId
+    // breaches a per-account limit, or 0. account must not be 0.
+    int check(int account, int orderId, int quantity) const
+    {
+        if (limits.maxOpenQuantity > 0 && openQuantity[account - 1] + quantity > limits.maxOpenQuantity)
+            return 10;
+        if (limits.maxOrders > 0 && limits.rateWindow > 0)
+        {
+            std::size_t ring = static_cast<std::size_t>(account - 1) * static_cast<std::size_t>(limits.maxOrders);
+            int oldest = recentOrders[ring + static_cast<std::size_t>(ringHeads[account - 1])];
+            if (oldest != 0 && orderId - oldest < limits.rateWindow)
+                return 11;
+        }
+        return 0;
+    }
+
+    // Counts an accepted order towards the account's rate limit.
+    void recordOrder(int account, int orderId)
+    {
+        if (account == 0 || limits.maxOrders <= 0 || limits.rateWindow <= 0)
+            return;
+        int &head = ringHeads[account - 1];
+        recentOrders[static_cast<std::size_t>(account - 1) * static_cast<std::size_t>(limits.maxOrders) +
+                     static_cast<std::size_t>(head)] = orderId;
+        head = head + 1 == limits.maxOrders ? 0 : head + 1;
+    }
+
+    // Visits the IDs of the account's orders that count towards its rate
+    // limit, oldest first, so recording them again rebuilds the ring.
+    template <typename Visit>
+    void forEachRecentOrder(int account, Visit visit) const
+    {
+        if (limits.maxOrders <= 0 || limits.rateWindow <= 0)
+            return;
+        std::size_t ring = static_cast<std::size_t>(account - 1) * static_cast<std::size_t>(limits.maxOrders);
+        for (int i = 0; i < limits.maxOrders; ++i)
+        {
+            int orderId = recentOrders[ring + static_cast<std::size_t>((ringHeads[account - 1] + i) % limits.maxOrders)];
+            if (orderId != 0)
+                visit(orderId);
+        }
+    }
+};
+
+#endif
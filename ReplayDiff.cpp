@@ -0,0 +1,666 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Accounts.h"
+#include "BatchValidator.h"
+#include "BinaryFormat.h"
+#include "Journal.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderGenerator.h"
+#include "OrderParser.h"
+#include "ReportWriter.h"
+
+using namespace std;
+
+// Differential replay: runs one order stream, generated by OrderGenerator or
+// recorded in an orders.csv file, through the reference engine (OrderBook
+// validating and matching order by order) and through other engine
+// configurations, and compares the execution reports line by line. The first
+// difference is printed with the order that caused it, and the input is then
+// shrunk to a small reproducer: cut after that order, then delta-debugged by
+// dropping ever smaller runs of orders as long as the outputs still differ.
+//
+// Built-in configurations:
+//
+//   batch-scalar, batch-sse4.2, batch-avx2   block validation as in main
+//   reserve                                  preallocated pool and books
+//   engine                                   MatchingEngine with a callback
+//   binary                                   binary orders in, binary reports out
+//   restore                                  journal and snapshot: a checkpoint
+//                                            after a quarter of the orders, a
+//                                            restart from the journal halfway
+//
+// --command runs an external engine instead, e.g. a build of main from
+// another tree: {input} and {output} in the command are replaced by an
+// orders.csv and an execution_rep.csv path, and its standard output is
+// discarded.
+
+typedef chrono::steady_clock Clock;
+
+const int CANDIDATE_REFERENCE = 0;
+const int CANDIDATE_BATCH = 1;
+const int CANDIDATE_RESERVE = 2;
+const int CANDIDATE_ENGINE = 3;
+const int CANDIDATE_BINARY = 4;
+const int CANDIDATE_RESTORE = 5;
+const int CANDIDATE_COMMAND = 6;
+
+struct Candidate
+{
+    string name;
+    int kind = CANDIDATE_REFERENCE;
+    BlockValidatorFunction validator = nullptr;
+};
+
+struct HarnessOptions
+{
+    int selfTradePrevention = STP_NONE;
+    vector<AuctionWindow> auctions;
+    string command;
+    string workDirectory = ".";
+};
+
+void configureBook(OrderBook &orderBook, const HarnessOptions &options)
+{
+    orderBook.setSelfTradePrevention(options.selfTradePrevention);
+    for (const AuctionWindow &window : options.auctions)
+        orderBook.scheduleAuction(window.firstOrderId, window.lastOrderId);
+}
+
+// Orders of one run and the CSV rows they were parsed from; the orders refer
+// to the rows' text.
+struct OrderStream
+{
+    vector<string_view> rows;
+    vector<Order> orders;
+};
+
+OrderStream selectOrders(const OrderStream &stream, const vector<size_t> &indexes)
+{
+    OrderStream selected;
+    selected.rows.reserve(indexes.size());
+    selected.orders.reserve(indexes.size());
+    for (size_t index : indexes)
+    {
+        selected.rows.push_back(stream.rows[index]);
+        selected.orders.push_back(stream.orders[index]);
+    }
+    return selected;
+}
+
+// Matches the orders one by one; orderEnds, if given, gets the number of
+// reports written after each order.
+void runReference(const vector<Order> &orders, const HarnessOptions &options, string &reports,
+                  vector<size_t> *orderEnds)
+{
+    ReportWriter output(reports);
+    OrderBook orderBook;
+    configureBook(orderBook, options);
+    for (const Order &incoming : orders)
+    {
+        Order order = incoming;
+        orderBook.processOrder(order, output);
+        if (orderEnds != nullptr)
+            orderEnds->push_back(output.records());
+    }
+    orderBook.uncross(output);
+    if (orderEnds != nullptr)
+        orderEnds->back() = output.records();
+}
+
+void runBatch(const vector<Order> &orders, const HarnessOptions &options, BlockValidatorFunction validate,
+              string &reports)
+{
+    ReportWriter output(reports);
+    OrderBook orderBook;
+    configureBook(orderBook, options);
+    BatchValidator validator(validate);
+    ValidationBlock block;
+    ValidationResult result;
+    Order batch[VALIDATION_BLOCK_SIZE];
+    for (size_t start = 0; start < orders.size(); start += VALIDATION_BLOCK_SIZE)
+    {
+        block.clear();
+        size_t count = min(VALIDATION_BLOCK_SIZE, orders.size() - start);
+        for (size_t i = 0; i < count; ++i)
+        {
+            batch[i] = orders[start + i];
+            block.add(batch[i]);
+        }
+        validator.run(block, result);
+        for (size_t i = 0; i < count; ++i)
+        {
+            batch[i].orderId = orderBook.nextOrderId();
+            orderBook.processValidatedOrder(batch[i], result.reasons[i], output);
+        }
+    }
+    orderBook.uncross(output);
+}
+
+void runReserved(const vector<Order> &orders, const HarnessOptions &options, string &reports)
+{
+    ReportWriter output(reports);
+    OrderBook orderBook;
+    configureBook(orderBook, options);
+    orderBook.reserve(orders.size());
+    for (const Order &incoming : orders)
+    {
+        Order order = incoming;
+        orderBook.processOrder(order, output);
+    }
+    orderBook.uncross(output);
+}
+
+void runEngine(const vector<Order> &orders, const HarnessOptions &options, string &reports)
+{
+    ReportWriter output(reports);
+    auto engine = makeMatchingEngine([&output](const ExecutionReport &report)
+                                     { writeExecutionReport(report, output); });
+    configureBook(engine.book(), options);
+    for (const Order &order : orders)
+        engine.submit(order);
+    engine.uncross();
+}
+
+void runBinary(const vector<Order> &orders, const HarnessOptions &options, string &reports)
+{
+    string orderFile;
+    {
+        ReportWriter output(orderFile);
+        writeBinaryHeader(output, ORDER_FILE_MAGIC, BINARY_ORDER_SIZE);
+        for (const Order &order : orders)
+            writeBinaryOrder(order, output);
+    }
+
+    string reportFile;
+    {
+        ReportWriter output(reportFile);
+        BinaryReportWriter binaryReports(output);
+        BinaryOrderReader reader;
+        reader.open(orderFile);
+        OrderBook orderBook;
+        configureBook(orderBook, options);
+        Order order;
+        while (reader.next(order))
+            orderBook.processOrder(order, binaryReports);
+        orderBook.uncross(binaryReports);
+    }
+
+    ReportWriter output(reports);
+    BinaryReportReader reader;
+    reader.open(reportFile);
+    ExecutionReport report;
+    while (reader.next(report))
+        writeExecutionReport(report, output);
+}
+
+// Journals the first half of the orders with a checkpoint after a quarter,
+// then drops the book as if the process died, restores a new one from the
+// snapshot and journal and matches the rest on it.
+bool runRestore(const vector<Order> &orders, const HarnessOptions &options, string &reports)
+{
+    string journalPath = options.workDirectory + "/diff_journal.bin";
+    string snapshotPath = options.workDirectory + "/diff_snapshot.bin";
+    remove(journalPath.c_str());
+    remove(snapshotPath.c_str());
+    size_t checkpointAt = orders.size() / 4;
+    size_t restartAt = orders.size() / 2;
+
+    ReportWriter output(reports);
+    bool restored = false;
+    {
+        OrderBook orderBook;
+        configureBook(orderBook, options);
+        Journal journal(journalPath, snapshotPath, 0);
+        RestoreStats stats;
+        if (journal.restore(orderBook, stats) && journal.checkpoint(orderBook))
+        {
+            JournaledOutput<ReportWriter> journaled{journal, output};
+            for (size_t i = 0; i < restartAt; ++i)
+            {
+                Order order = orders[i];
+                order.orderId = orderBook.nextOrderId();
+                journal.recordOrder(order, orderBook.validateOrder(order));
+                orderBook.processNumberedOrder(order, journaled);
+                if (i + 1 == checkpointAt)
+                    journal.checkpoint(orderBook);
+            }
+            restored = true;
+        }
+    }
+
+    OrderBook orderBook;
+    configureBook(orderBook, options);
+    Journal journal(journalPath, snapshotPath, 0);
+    RestoreStats stats;
+    if (restored)
+        restored = journal.restore(orderBook, stats);
+    remove(journalPath.c_str());
+    remove(snapshotPath.c_str());
+    if (!restored)
+        return false;
+    for (size_t i = restartAt; i < orders.size(); ++i)
+    {
+        Order order = orders[i];
+        orderBook.processOrder(order, output);
+    }
+    orderBook.uncross(output);
+    return true;
+}
+
+string replaceAll(string text, const string &from, const string &to)
+{
+    for (size_t position = text.find(from); position != string::npos; position = text.find(from, position + to.size()))
+        text.replace(position, from.size(), to);
+    return text;
+}
+
+// Runs the external command on the rows; its report header is dropped.
+bool runCommand(const vector<string_view> &rows, const HarnessOptions &options, string &reports)
+{
+    string inputPath = options.workDirectory + "/diff_orders.csv";
+    string outputPath = options.workDirectory + "/diff_execution_rep.csv";
+    {
+        ReportWriter input(inputPath.c_str());
+        if (!input.is_open())
+            return false;
+        input.append("Cl. Ord. ID,Instrument,Side,Price,Quantity,Type,Account").endRecord();
+        for (string_view row : rows)
+            input.append(row).endRecord();
+    }
+    remove(outputPath.c_str());
+
+    string command = replaceAll(replaceAll(options.command, "{input}", inputPath), "{output}", outputPath);
+    int status = system((command + " > /dev/null").c_str());
+
+    MappedFile output;
+    bool ran = status == 0 && output.open(outputPath.c_str());
+    if (ran)
+    {
+        string_view text = output.contents();
+        if (text.substr(0, 15) == "Client Order ID")
+        {
+            size_t end = text.find('\n');
+            text = end == string_view::npos ? string_view() : text.substr(end + 1);
+        }
+        reports.assign(text.data(), text.size());
+    }
+    remove(inputPath.c_str());
+    remove(outputPath.c_str());
+    return ran;
+}
+
+// Returns false if the configuration could not run at all, which counts as
+// a difference.
+bool runCandidate(const Candidate &candidate, const OrderStream &stream, const HarnessOptions &options,
+                  string &reports)
+{
+    reports.clear();
+    switch (candidate.kind)
+    {
+    case CANDIDATE_BATCH:
+        runBatch(stream.orders, options, candidate.validator, reports);
+        return true;
+    case CANDIDATE_RESERVE:
+        runReserved(stream.orders, options, reports);
+        return true;
+    case CANDIDATE_ENGINE:
+        runEngine(stream.orders, options, reports);
+        return true;
+    case CANDIDATE_BINARY:
+        runBinary(stream.orders, options, reports);
+        return true;
+    case CANDIDATE_RESTORE:
+        return runRestore(stream.orders, options, reports);
+    case CANDIDATE_COMMAND:
+        return runCommand(stream.rows, options, reports);
+    default:
+        runReference(stream.orders, options, reports, nullptr);
+        return true;
+    }
+}
+
+const size_t NO_DIFFERENCE = static_cast<size_t>(-1);
+
+// Returns the index of the first report line that differs, or NO_DIFFERENCE.
+// A stream that ends early differs at its end, with an empty line.
+size_t firstDifference(string_view expected, string_view actual, string_view &expectedLine, string_view &actualLine)
+{
+    LineScanner expectedLines(expected);
+    LineScanner actualLines(actual);
+    for (size_t index = 0;; ++index)
+    {
+        expectedLine = string_view();
+        actualLine = string_view();
+        bool moreExpected = expectedLines.next(expectedLine);
+        bool moreActual = actualLines.next(actualLine);
+        if (!moreExpected && !moreActual)
+            return NO_DIFFERENCE;
+        if (moreExpected != moreActual || expectedLine != actualLine)
+            return index;
+    }
+}
+
+bool differs(const Candidate &candidate, const OrderStream &stream, const HarnessOptions &options)
+{
+    string expected;
+    string actual;
+    runReference(stream.orders, options, expected, nullptr);
+    if (!runCandidate(candidate, stream, options, actual))
+        return true;
+    string_view expectedLine;
+    string_view actualLine;
+    return firstDifference(expected, actual, expectedLine, actualLine) != NO_DIFFERENCE;
+}
+
+// Delta debugging: tries to drop each of granularity runs of orders in turn,
+// keeps any cut after which the outputs still differ, and refines the runs
+// down to single orders. Stops after trialLimit runs.
+vector<size_t> shrink(const OrderStream &stream, vector<size_t> failing, const Candidate &candidate,
+                      const HarnessOptions &options, size_t trialLimit, size_t &trials)
+{
+    size_t granularity = 2;
+    while (failing.size() >= 2 && trials < trialLimit)
+    {
+        size_t chunk = (failing.size() + granularity - 1) / granularity;
+        bool reduced = false;
+        for (size_t start = 0; start < failing.size() && trials < trialLimit; start += chunk)
+        {
+            vector<size_t> rest(failing.begin(), failing.begin() + start);
+            rest.insert(rest.end(), failing.begin() + min(start + chunk, failing.size()), failing.end());
+            ++trials;
+            if (!rest.empty() && differs(candidate, selectOrders(stream, rest), options))
+            {
+                failing.swap(rest);
+                granularity = max<size_t>(granularity - 1, 2);
+                reduced = true;
+                break;
+            }
+        }
+        if (reduced)
+            continue;
+        if (granularity >= failing.size())
+            break;
+        granularity = min(failing.size(), granularity * 2);
+    }
+    return failing;
+}
+
+bool writeOrders(const string &path, const vector<string_view> &rows)
+{
+    ReportWriter output(path.c_str());
+    if (!output.is_open())
+        return false;
+    output.append("Cl. Ord. ID,Instrument,Side,Price,Quantity,Type,Account").endRecord();
+    for (string_view row : rows)
+        output.append(row).endRecord();
+    return true;
+}
+
+// Compares one configuration with the reference and shrinks a difference.
+// Returns true if the reports are identical.
+bool checkCandidate(const Candidate &candidate, const OrderStream &stream, const HarnessOptions &options,
+                    const string &expected, const vector<size_t> &orderEnds, size_t trialLimit,
+                    const string &reproDirectory)
+{
+    string actual;
+    Clock::time_point start = Clock::now();
+    bool ran = runCandidate(candidate, stream, options, actual);
+    double milliseconds = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    string_view expectedLine;
+    string_view actualLine;
+    size_t difference = ran ? firstDifference(expected, actual, expectedLine, actualLine) : 0;
+    if (difference == NO_DIFFERENCE)
+    {
+        cout << candidate.name << ": identical, " << orderEnds.back() << " reports in "
+             << static_cast<long long>(milliseconds) << " ms" << endl;
+        return true;
+    }
+
+    // The report at difference came out of the first order whose reports
+    // reach past it.
+    size_t failingOrder = upper_bound(orderEnds.begin(), orderEnds.end(), difference) - orderEnds.begin();
+    failingOrder = min(failingOrder, stream.orders.size() - 1);
+    if (!ran)
+        cout << candidate.name << ": could not run" << endl;
+    else
+        cout << candidate.name << ": differs at report " << difference + 1 << ", from order " << failingOrder + 1
+             << " (" << stream.rows[failingOrder] << ")\n  expected: " << expectedLine << "\n  actual:   "
+             << actualLine << endl;
+
+    vector<size_t> failing(failingOrder + 1);
+    for (size_t i = 0; i < failing.size(); ++i)
+        failing[i] = i;
+    size_t trials = 1;
+    if (!differs(candidate, selectOrders(stream, failing), options))
+    {
+        failing.resize(stream.orders.size());
+        for (size_t i = 0; i < failing.size(); ++i)
+            failing[i] = i;
+    }
+    failing = shrink(stream, failing, candidate, options, trialLimit, trials);
+
+    OrderStream repro = selectOrders(stream, failing);
+    string reproPath = reproDirectory + "/repro_" + candidate.name + ".csv";
+    if (!writeOrders(reproPath, repro.rows))
+        cerr << "Error: Could not open " << reproPath << endl;
+    cout << "  shrunk to " << repro.rows.size() << " orders in " << trials << " runs, written to " << reproPath
+         << endl;
+
+    string reproExpected;
+    string reproActual;
+    runReference(repro.orders, options, reproExpected, nullptr);
+    if (runCandidate(candidate, repro, options, reproActual))
+    {
+        size_t reproDifference = firstDifference(reproExpected, reproActual, expectedLine, actualLine);
+        if (reproDifference != NO_DIFFERENCE)
+            cout << "  report " << reproDifference + 1 << " expected: " << expectedLine << "\n  report "
+                 << reproDifference + 1 << " actual:   " << actualLine << endl;
+    }
+    return false;
+}
+
+bool findCandidate(const string &name, Candidate &candidate)
+{
+    candidate = Candidate();
+    candidate.name = name;
+    if (name.compare(0, 6, "batch-") == 0)
+    {
+        candidate.kind = CANDIDATE_BATCH;
+        candidate.validator = selectBlockValidator(name.substr(6));
+        return name != "batch-auto" && candidate.validator != nullptr;
+    }
+    if (name == "reserve")
+        candidate.kind = CANDIDATE_RESERVE;
+    else if (name == "engine")
+        candidate.kind = CANDIDATE_ENGINE;
+    else if (name == "binary")
+        candidate.kind = CANDIDATE_BINARY;
+    else if (name == "restore")
+        candidate.kind = CANDIDATE_RESTORE;
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorConfig config;
+    HarnessOptions options;
+    string inputPath;
+    string recordPath;
+    string instrumentsPath;
+    string reproDirectory = ".";
+    size_t trialLimit = 2000;
+    vector<string> candidateNames;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--input" && i + 1 < argc)
+            inputPath = argv[++i];
+        else if (arg == "--orders" && i + 1 < argc)
+            config.orders = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc)
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--aggressive" && i + 1 < argc)
+            config.aggressiveRatio = atof(argv[++i]);
+        else if (arg == "--invalid" && i + 1 < argc)
+            config.invalidRate = atof(argv[++i]);
+        else if (arg == "--accounts" && i + 1 < argc)
+            config.accounts = atoi(argv[++i]);
+        else if (arg == "--instruments" && i + 1 < argc)
+            instrumentsPath = argv[++i];
+        else if (arg == "--stp" && i + 1 < argc && stringToSelfTradePrevention(argv[i + 1]) != STP_MODE_COUNT)
+            options.selfTradePrevention = stringToSelfTradePrevention(argv[++i]);
+        else if (arg == "--auction" && i + 2 < argc)
+        {
+            options.auctions.push_back(AuctionWindow{atoi(argv[i + 1]), atoi(argv[i + 2])});
+            i += 2;
+        }
+        else if (arg == "--candidate" && i + 1 < argc)
+            candidateNames.push_back(argv[++i]);
+        else if (arg == "--command" && i + 1 < argc)
+            options.command = argv[++i];
+        else if (arg == "--work-dir" && i + 1 < argc)
+            options.workDirectory = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--repro-dir" && i + 1 < argc)
+            reproDirectory = argv[++i];
+        else if (arg == "--shrink-runs" && i + 1 < argc)
+            trialLimit = strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--input FILE | --orders N --seed N [--aggressive RATIO]"
+                 << " [--invalid RATIO] [--accounts N]] [--instruments FILE]"
+                 << " [--stp none|cancel-newest|cancel-oldest|decrement-both] [--auction FIRST LAST]..."
+                 << " [--candidate NAME]..."
+                 << " [--command CMD] [--work-dir DIR] [--record FILE] [--repro-dir DIR] [--shrink-runs N]" << endl;
+            return 2;
+        }
+    }
+
+    if (!instrumentsPath.empty())
+    {
+        size_t errorLine = 0;
+        InstrumentUniverse universe;
+        if (!loadInstrumentUniverse(instrumentsPath.c_str(), universe, errorLine))
+        {
+            cerr << "Error: Invalid instrument file " << instrumentsPath << " at line " << errorLine << endl;
+            return 2;
+        }
+        instrumentUniverse() = universe;
+    }
+
+    OrderBook scheduled;
+    for (const AuctionWindow &window : options.auctions)
+    {
+        if (!scheduled.scheduleAuction(window.firstOrderId, window.lastOrderId))
+        {
+            cerr << "Error: Invalid auction window " << window.firstOrderId << " " << window.lastOrderId << endl;
+            return 2;
+        }
+    }
+
+    vector<Candidate> candidates;
+    if (candidateNames.empty() && options.command.empty())
+        candidateNames = {"batch-scalar", "batch-sse4.2", "batch-avx2", "reserve", "engine", "binary", "restore"};
+    for (const string &name : candidateNames)
+    {
+        Candidate candidate;
+        if (findCandidate(name, candidate))
+            candidates.push_back(candidate);
+        else if (name.compare(0, 6, "batch-") == 0 && candidateNames.size() > 1)
+            cout << name << ": not available on this CPU or build" << endl;
+        else
+        {
+            cerr << "Error: Unknown configuration " << name << endl;
+            return 2;
+        }
+    }
+    if (!options.command.empty())
+    {
+        Candidate candidate;
+        candidate.name = "command";
+        candidate.kind = CANDIDATE_COMMAND;
+        candidates.push_back(candidate);
+    }
+
+    string generated;
+    MappedFile inputFile;
+    string_view text;
+    if (inputPath.empty())
+    {
+        ReportWriter output(generated);
+        output.append("Cl. Ord. ID,Instrument,Side,Price,Quantity,Type,Account").endRecord();
+        OrderGenerator generator(config);
+        while (generator.next(output))
+        {
+        }
+        output.flush();
+        text = generated;
+    }
+    else
+    {
+        if (!inputFile.open(inputPath.c_str()))
+        {
+            cerr << "Error: Could not open " << inputPath << endl;
+            return 2;
+        }
+        text = inputFile.contents();
+    }
+
+    // Rows that are not orders get no order ID in any configuration, so the
+    // stream is the rows that parse.
+    OrderStream stream;
+    {
+        LineScanner lines(text);
+        string_view line;
+        lines.next(line);
+        Order order;
+        while (lines.next(line))
+        {
+            string_view row = line;
+            if (!row.empty() && row.back() == '\r')
+                row.remove_suffix(1);
+            if (row.empty() || !parseOrderLine(line, order))
+                continue;
+            stream.rows.push_back(row);
+            stream.orders.push_back(order);
+        }
+    }
+    if (stream.orders.empty())
+    {
+        cerr << "Error: No orders to replay" << endl;
+        return 2;
+    }
+    if (!recordPath.empty() && !writeOrders(recordPath, stream.rows))
+    {
+        cerr << "Error: Could not open " << recordPath << endl;
+        return 2;
+    }
+
+    string expected;
+    vector<size_t> orderEnds;
+    orderEnds.reserve(stream.orders.size());
+    Clock::time_point start = Clock::now();
+    runReference(stream.orders, options, expected, &orderEnds);
+    double milliseconds = chrono::duration<double, milli>(Clock::now() - start).count();
+    cout << "reference: " << stream.orders.size() << " orders, " << orderEnds.back() << " reports in "
+         << static_cast<long long>(milliseconds) << " ms" << endl;
+
+    bool identical = true;
+    for (const Candidate &candidate : candidates)
+        identical = checkCandidate(candidate, stream, options, expected, orderEnds, trialLimit, reproDirectory) &&
+                    identical;
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Buffered CSV sink for report files. Fields are formatted straight into one
+// reusable byte buffer and written out in large blocks, either when the buffer
+// fills up or, if flushRecords is set, after that many records. A writer can
+// also collect its output in a string, e.g. for sending over a socket.
+class ReportWriter
+{
+private:
+    std::ofstream output;
+    std::string *target = nullptr;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+    std::size_t flushRecords;
+    std::size_t pendingRecords = 0;
+    std::size_t recordCount = 0;
+
+    char *reserve(std::size_t length)
+    {
+        if (buffer.size() - used < length)
+            flush();
+        return buffer.data() + used;
+    }
+
+public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    explicit ReportWriter(const char *path, std::size_t bufferSize = DEFAULT_BUFFER_SIZE, std::size_t flushRecords = 0)
+        : output(path, std::ios::binary), buffer(bufferSize < 64 ? 64 : bufferSize), flushRecords(flushRecords)
+    {
+    }
+
+    // Appends the output to target on every flush instead of writing a file.
+    explicit ReportWriter(std::string &target, std::size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : target(&target), buffer(bufferSize < 64 ? 64 : bufferSize), flushRecords(0)
+    {
+    }
+
+    ReportWriter(const ReportWriter &) = delete;
+    ReportWriter &operator=(const ReportWriter &) = delete;
+
+    ~ReportWriter()
+    {
+        flush();
+    }
+
+    // Number of records ended so far.
+    std::size_t records() const
+    {
+        return recordCount;
+    }
+
+    bool is_open() const
+    {
+        return target != nullptr || output.is_open();
+    }
+
+    // False once writing, flushing or closing the file has failed, e.g. on a
+    // full disk. Output still in the buffer is not checked until a flush.
+    bool good() const
+    {
+        return target != nullptr || output.good();
+    }
+
+    void flush()
+    {
+        if (target != nullptr)
+        {
+            target->append(buffer.data(), used);
+            used = 0;
+            pendingRecords = 0;
+            return;
+        }
+        if (used > 0)
+        {
+            output.write(buffer.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+        pendingRecords = 0;
+        output.flush();
+    }
+
+    void close()
+    {
+        flush();
+        output.close();
+    }
+
+    ReportWriter &append(std::string_view text)
+    {
+        if (text.size() > buffer.size())
+        {
+            flush();
+            if (target != nullptr)
+                target->append(text.data(), text.size());
+            else
+                output.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return *this;
+        }
+        std::memcpy(reserve(text.size()), text.data(), text.size());
+        used += text.size();
+        return *this;
+    }
+
+    ReportWriter &append(char c)
+    {
+        *reserve(1) = c;
+        ++used;
+        return *this;
+    }
+
+    ReportWriter &appendInt(long long value)
+    {
+        char *out = reserve(20);
+        unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value) : value;
+        char digits[20];
+        int count = 0;
+        do
+        {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+
+        if (value < 0)
+            *out++ = '-';
+        while (count > 0)
+            *out++ = digits[--count];
+        used = out - buffer.data();
+        return *this;
+    }
+
+    // Writes value / 10^decimals with exactly that many decimal places, e.g.
+    // appendFixed(105, 2) writes "1.05".
+    ReportWriter &appendFixed(long long value, int decimals)
+    {
+        long long scale = 1;
+        for (int i = 0; i < decimals; ++i)
+            scale *= 10;
+
+        if (value < 0)
+        {
+            append('-');
+            value = -value;
+        }
+        appendInt(value / scale);
+        if (decimals > 0)
+        {
+            char *out = reserve(decimals + 1);
+            *out++ = '.';
+            long long fraction = value % scale;
+            for (int i = decimals - 1; i >= 0; --i)
+            {
+                out[i] = static_cast<char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+            used = out + decimals - buffer.data();
+        }
+        return *this;
+    }
+
+    // Formats a double the way an ostream does by default (%g, 6 significant
+    // digits), for reports that still carry floating-point prices.
+    ReportWriter &appendDouble(double value)
+    {
+        char *out = reserve(32);
+        std::to_chars_result result = std::to_chars(out, out + 32, value, std::chars_format::general, 6);
+        used = result.ptr - buffer.data();
+        return *this;
+    }
+
+    // Ends the current record with a newline and flushes if the record limit
+    // has been reached.
+    void endRecord()
+    {
+        append('\n');
+        endBinaryRecord();
+    }
+
+    // Counts a record that carries no line ending, such as a fixed-width
+    // binary record, towards the flush limit.
+    void endBinaryRecord()
+    {
+        ++recordCount;
+        if (flushRecords != 0 && ++pendingRecords >= flushRecords)
+            flush();
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ThreadPlacement.h"
+
+// Bounded lock-free ring buffer for exactly one producer thread and one
+// consumer thread. Capacity is rounded up to a power of two. Each side keeps
+// a cached copy of the other side's index so it only touches the shared
+// cache line when the ring looks full or empty.
+//
+// push and pop wait for room or for a value in the queue's wait mode (see
+// ThreadPlacement.h): yielding by default, spinning, or blocking. A side
+// that blocks counts itself in sleepers before it looks at the ring one
+// last time, and the other side checks sleepers after every push or pop,
+// so the only cost of blocking while nobody sleeps is that check.
+template <typename T>
+class SpscQueue
+{
+private:
+    std::vector<T> slots;
+    std::size_t mask;
+
+    alignas(64) std::atomic<std::size_t> head{0};
+    std::size_t cachedTail = 0;
+
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::size_t cachedHead = 0;
+
+    int waitMode = WAIT_YIELD;
+    alignas(64) std::atomic<int> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+
+    // Wakes the other side if it sleeps. The fence keeps the index store
+    // before the sleepers load, pairing with the fence in wait.
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeup.notify_all();
+        }
+    }
+
+    // Retries attempt until it succeeds, waiting in between.
+    template <typename Attempt>
+    void wait(Attempt attempt)
+    {
+        while (!attempt())
+        {
+            if (waitMode == WAIT_SPIN)
+            {
+                cpuRelax();
+                continue;
+            }
+            if (waitMode == WAIT_YIELD)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool done = attempt();
+            if (!done)
+                wakeup.wait_for(lock, std::chrono::milliseconds(1));
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (done)
+                return;
+        }
+    }
+
+public:
+    explicit SpscQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Set before either side starts using the queue.
+    void setWaitMode(int mode)
+    {
+        waitMode = mode;
+    }
+
+    // Producer side. Moves from value only when there was room for it.
+    bool tryPush(T &value)
+    {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        if (position - cachedHead > mask)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position - cachedHead > mask)
+                return false;
+        }
+        slots[position & mask] = std::move(value);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool tryPop(T &value)
+    {
+        std::size_t position = head.load(std::memory_order_relaxed);
+        if (position == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position == cachedTail)
+                return false;
+        }
+        value = std::move(slots[position & mask]);
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T &value)
+    {
+        wait([&]()
+             { return tryPush(value); });
+        if (waitMode == WAIT_BLOCK)
+            wake();
+    }
+
+    void pop(T &value)
+    {
+        wait([&]()
+             { return tryPop(value); });
+        if (waitMode == WAIT_BLOCK)
+            wake();
+    }
+};
+
+#endif
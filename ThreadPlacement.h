@@ -0,0 +1,188 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Where the engine's threads run and how they wait for each other.
+//
+// A thread pinned to a CPU stays on it, so its cache and its memory stay
+// local; a pinned thread also allocates from its CPU's NUMA node. Books are
+// built by the thread that matches them, so a pinned shard's books land on
+// its own node.
+//
+// Waiting threads (a shard with no orders, the report writer with no
+// reports, the server with no input) either block until woken, which costs
+// a wakeup of several microseconds on every handoff but no CPU while idle,
+// yield the CPU between polls, or busy-spin, which answers within
+// nanoseconds but keeps the CPU at 100%. Spinning only pays off with every
+// spinning thread pinned to a core of its own.
+
+const int WAIT_BLOCK = 0;
+const int WAIT_YIELD = 1;
+const int WAIT_SPIN = 2;
+const int WAIT_MODE_COUNT = 3;
+
+inline const char *waitModeToString(int mode)
+{
+    switch (mode)
+    {
+    case WAIT_BLOCK:
+        return "block";
+    case WAIT_YIELD:
+        return "yield";
+    case WAIT_SPIN:
+        return "spin";
+    default:
+        return "";
+    }
+}
+
+// Returns WAIT_MODE_COUNT for a name that is not a mode.
+inline int stringToWaitMode(std::string_view mode)
+{
+    for (int i = 0; i < WAIT_MODE_COUNT; ++i)
+    {
+        if (mode == waitModeToString(i))
+            return i;
+    }
+    return WAIT_MODE_COUNT;
+}
+
+// One round of a busy wait. PAUSE tells the core the thread is spinning,
+// which leaves a hyperthread sibling more of the core and avoids the
+// pipeline flush when the wait ends.
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+const int MAX_CPU = 1023;
+
+// Parses a CPU list like "0,2,4-7" into cpus, in the order given. Returns
+// false for anything else.
+inline bool parseCpuList(std::string_view text, std::vector<int> &cpus)
+{
+    auto parse = [](std::string_view digits, int &value)
+    {
+        if (digits.empty() || digits.size() > 4)
+            return false;
+        value = 0;
+        for (char c : digits)
+        {
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
+        }
+        return value <= MAX_CPU;
+    };
+    cpus.clear();
+    std::size_t start = 0;
+    while (start <= text.size())
+    {
+        std::size_t end = text.find(',', start);
+        if (end == std::string_view::npos)
+            end = text.size();
+        std::string_view item = text.substr(start, end - start);
+        std::size_t dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (dash == std::string_view::npos)
+        {
+            if (!parse(item, first))
+                return false;
+            last = first;
+        }
+        else if (!parse(item.substr(0, dash), first) || !parse(item.substr(dash + 1), last) || last < first)
+        {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+        start = end + 1;
+    }
+    return !cpus.empty();
+}
+
+// NUMA node of a CPU as the kernel lists it in sysfs, or -1 if unknown.
+inline int numaNodeOfCpu(int cpu)
+{
+#if defined(__linux__)
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *directory = opendir(path.c_str());
+    if (directory == nullptr)
+        return -1;
+    int node = -1;
+    while (dirent *entry = readdir(directory))
+    {
+        std::string_view name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0)
+        {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(directory);
+    return node;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+// Pins the calling thread to cpu, and makes the memory it touches first
+// from now on come from that CPU's NUMA node even if the process was
+// started with another policy (e.g. numactl --interleave). Returns false if
+// the thread could not be pinned, e.g. outside Linux or for a CPU the
+// process may not use.
+inline bool pinThisThread(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return false;
+#ifdef SYS_set_mempolicy
+    const int MPOL_LOCAL_POLICY = 4;
+    syscall(SYS_set_mempolicy, MPOL_LOCAL_POLICY, nullptr, 0);
+#endif
+    return true;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// The CPUs threads are pinned to, by thread number; threads past the end of
+// the list are not pinned.
+struct ThreadPlacement
+{
+    std::vector<int> cpus;
+
+    int cpuFor(std::size_t thread) const
+    {
+        return thread < cpus.size() ? cpus[thread] : -1;
+    }
+};
+
+#endif
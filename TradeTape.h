@@ -0,0 +1,190 @@
+#ifndef TRADE_TAPE_H
+#define TRADE_TAPE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "ReportWriter.h"
+
+// Trade tape and trade statistics for an OrderBook, written as CSV lines:
+//
+//   Trade,seq,instrument,price,quantity,aggressor side,buy order ID,sell order ID
+//   Bar,seq,bar,instrument,open,high,low,close,volume,trades,VWAP,running VWAP
+//   Session,seq,instrument,open,high,low,close,volume,trades,VWAP
+//
+// A Trade line is one match, where the fill reports give two lines; the
+// aggressor is the side of the incoming order, or 0 in an auction uncross.
+// Bar lines are OHLCV bars of barInterval order IDs each (bar n covers order
+// IDs (n-1)*barInterval+1 to n*barInterval), so bars line up the same in
+// every run of the same orders; they are written, instrument by instrument,
+// once the first order of a later bar arrives, and instruments that did not
+// trade get none. The running VWAP is the VWAP of every trade so far.
+// Session lines close the run with each traded instrument's totals. VWAPs
+// have four decimals; every statistic is updated in constant time per trade.
+// seq increases by one per line, as in the market-data feed.
+
+// OHLCV of one instrument over some trades; prices in ticks.
+struct TradeBar
+{
+    long long open = 0;
+    long long high = 0;
+    long long low = 0;
+    long long close = 0;
+    long long volume = 0;
+    long long notional = 0;
+    long long trades = 0;
+
+    void add(long long price, int quantity)
+    {
+        if (trades == 0)
+        {
+            open = price;
+            high = price;
+            low = price;
+        }
+        else
+        {
+            high = std::max(high, price);
+            low = std::min(low, price);
+        }
+        close = price;
+        volume += quantity;
+        notional += price * quantity;
+        ++trades;
+    }
+
+    // Volume-weighted average price in ten-thousandths, rounded half up; 0
+    // without trades.
+    long long vwap() const
+    {
+        const long long scale = 10000 / TICKS_PER_UNIT;
+        return volume == 0 ? 0 : (notional * scale + volume / 2) / volume;
+    }
+};
+
+const int VWAP_DECIMALS = 4;
+
+class TradeRecorder
+{
+private:
+    OrderBook &orderBook;
+    ReportWriter &output;
+    int barInterval;
+    std::vector<Trade> trades;
+    std::vector<TradeBar> bars;
+    std::vector<TradeBar> sessions;
+    long long bar = 0;
+    std::uint64_t sequence = 0;
+
+    void appendBar(const TradeBar &traded)
+    {
+        output.appendFixed(traded.open, PRICE_DECIMALS).append(',')
+            .appendFixed(traded.high, PRICE_DECIMALS).append(',')
+            .appendFixed(traded.low, PRICE_DECIMALS).append(',')
+            .appendFixed(traded.close, PRICE_DECIMALS).append(',')
+            .appendInt(traded.volume).append(',')
+            .appendInt(traded.trades).append(',')
+            .appendFixed(traded.vwap(), VWAP_DECIMALS);
+    }
+
+    void writeTrade(const Trade &trade)
+    {
+        output.append("Trade,").appendInt(static_cast<long long>(++sequence)).append(',')
+            .append(instrumentToString(trade.instrument)).append(',')
+            .appendFixed(trade.price, PRICE_DECIMALS).append(',')
+            .appendInt(trade.quantity).append(',')
+            .appendInt(trade.aggressorSide).append(',')
+            .append("ord").appendInt(trade.buyOrderId).append(',')
+            .append("ord").appendInt(trade.sellOrderId);
+        output.endRecord();
+    }
+
+    // Writes and resets the bar of every instrument that traded in it.
+    void closeBars()
+    {
+        for (std::size_t i = 0; i < bars.size(); ++i)
+        {
+            if (bars[i].trades == 0)
+                continue;
+            output.append("Bar,").appendInt(static_cast<long long>(++sequence)).append(',')
+                .appendInt(bar + 1).append(',')
+                .append(instrumentToString(static_cast<InstrumentType>(i))).append(',');
+            appendBar(bars[i]);
+            output.append(',').appendFixed(sessions[i].vwap(), VWAP_DECIMALS);
+            output.endRecord();
+            bars[i] = TradeBar();
+        }
+    }
+
+public:
+    // Starts logging the book's trades; the book must outlive the recorder.
+    // A barInterval of 0 writes no bars.
+    TradeRecorder(OrderBook &orderBook, ReportWriter &output, int barInterval)
+        : orderBook(orderBook), output(output), barInterval(barInterval), bars(instrumentCount()),
+          sessions(instrumentCount())
+    {
+        trades.reserve(64);
+        orderBook.logTrades(&trades);
+    }
+
+    TradeRecorder(const TradeRecorder &) = delete;
+    TradeRecorder &operator=(const TradeRecorder &) = delete;
+
+    ~TradeRecorder()
+    {
+        orderBook.logTrades(nullptr);
+    }
+
+    // Records the trades of the order with ID orderId; call it after every
+    // order, with order IDs that never go down.
+    void publish(int orderId)
+    {
+        if (barInterval > 0)
+        {
+            long long index = (static_cast<long long>(orderId) - 1) / barInterval;
+            if (index != bar)
+            {
+                closeBars();
+                bar = index;
+            }
+        }
+        if (trades.empty())
+            return;
+
+        for (const Trade &trade : trades)
+        {
+            writeTrade(trade);
+            std::size_t id = static_cast<std::size_t>(trade.instrument);
+            if (barInterval > 0)
+                bars[id].add(trade.price, trade.quantity);
+            sessions[id].add(trade.price, trade.quantity);
+        }
+        trades.clear();
+    }
+
+    // Writes the last, unfinished bars and the session totals.
+    void finish()
+    {
+        closeBars();
+        for (std::size_t i = 0; i < sessions.size(); ++i)
+        {
+            if (sessions[i].trades == 0)
+                continue;
+            output.append("Session,").appendInt(static_cast<long long>(++sequence)).append(',')
+                .append(instrumentToString(static_cast<InstrumentType>(i))).append(',');
+            appendBar(sessions[i]);
+            output.endRecord();
+        }
+    }
+
+    const TradeBar &session(InstrumentType instrument) const
+    {
+        return sessions[static_cast<std::size_t>(instrument)];
+    }
+};
+
+#endif
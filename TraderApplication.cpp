@@ -9,9 +9,9 @@
 #include <chrono>
 #include <algorithm>
 
-using namespace std;
+#include "ReportWriter.h"
 
-int id=0, orderid=0;
+using namespace std;
 
 enum class InstrumentType {
     Rose,
@@ -27,11 +27,6 @@ struct Order {
     int side;
     double price;
     int quantity;
-
-    int generateOrderId(){
-        orderid= ++id;
-        return orderid;
-    }
 };
 
 struct ExecutionReport {
@@ -43,6 +38,16 @@ struct ExecutionReport {
     int status;
 };
 
+void writeExecutionReport(const ExecutionReport &executionReport, ReportWriter &output) {
+    output.append(executionReport.clientOrderId).append(',')
+        .append(executionReport.orderId).append(',')
+        .appendInt(static_cast<int>(executionReport.instrument)).append(',')
+        .appendDouble(executionReport.price).append(',')
+        .appendInt(executionReport.quantity).append(',')
+        .appendInt(executionReport.status);
+    output.endRecord();
+}
+
 struct BuySideComparator {
     bool operator()(Order &a, Order &b) {
         return a.price < b.price;
@@ -60,9 +65,14 @@ class OrderBook {
 private:
         unordered_map<InstrumentType,  pair< priority_queue<Order,  vector<Order>, BuySideComparator>,
         priority_queue<Order,  vector<Order>, SellSideComparator>>> orderBooks;
+        int lastOrderId = 0;
+
+    int nextOrderId() {
+        return ++lastOrderId;
+    }
 
 public:
-    void processOrder(Order &order,  ofstream &output) {
+    void processOrder(Order &order,  ReportWriter &output) {
         ExecutionReport executionReport;
         executionReport.clientOrderId = order.clientOrderId;
         executionReport.instrument = order.instrument;
@@ -91,7 +101,7 @@ public:
             priority_queue<Order,  vector<Order>, BuySideComparator> &buySide = orderBook.first;
             priority_queue<Order,  vector<Order>, SellSideComparator> &sellSide = orderBook.second;
 
-            executionReport.orderId = orderid;
+            executionReport.orderId = lastOrderId;
             executionReport.price = order.price;
             executionReport.quantity = order.quantity;
 
@@ -112,12 +122,7 @@ public:
 
                     order.quantity -= matchedQuantity;
 
-                    output << executionReport.clientOrderId << ","
-                        << executionReport.orderId << ","
-                        << static_cast<int>(executionReport.instrument) << ","
-                        << executionReport.price << ","
-                        << executionReport.quantity << ","
-                        << executionReport.status <<  endl;
+                    writeExecutionReport(executionReport, output);
                 }
 
                 if (order.quantity > 0) {
@@ -141,12 +146,7 @@ public:
 
                     order.quantity -= matchedQuantity;
 
-                    output << executionReport.clientOrderId << ","
-                        << executionReport.orderId << ","
-                        << static_cast<int>(executionReport.instrument) << ","
-                        << executionReport.price << ","
-                        << executionReport.quantity << ","
-                        << executionReport.status <<  endl;
+                    writeExecutionReport(executionReport, output);
                 }
 
                 if (order.quantity > 0) {
@@ -157,8 +157,8 @@ public:
     }
 
     void printExecutionReport() {
-         ofstream output("report.csv");
-        output << "Client_order_ID,Order_ID,Instrument,Price,Quantity,Status" <<  endl;
+        ReportWriter output("report.csv");
+        output.append("Client_order_ID,Order_ID,Instrument,Price,Quantity,Status").endRecord();
 
         for (auto &orderBook : orderBooks) {
             priority_queue<Order,  vector<Order>, BuySideComparator>&buySide = orderBook.second.first;
@@ -170,18 +170,13 @@ public:
 
                 ExecutionReport executionReport;
                 executionReport.clientOrderId = order.clientOrderId;
-                executionReport.orderId = order.generateOrderId();
+                executionReport.orderId = nextOrderId();
                 executionReport.instrument = order.instrument;
                 executionReport.price = order.price;
                 executionReport.quantity = order.quantity;
                 executionReport.status = 3;
 
-                output << executionReport.clientOrderId << ","
-                    << executionReport.orderId << ","
-                    << static_cast<int>(executionReport.instrument) << ","
-                    << executionReport.price << ","
-                    << executionReport.quantity << ","
-                    << executionReport.status <<  endl;
+                writeExecutionReport(executionReport, output);
             }
 
             while (!sellSide.empty()) {
@@ -190,18 +185,13 @@ public:
 
                 ExecutionReport executionReport;
                 executionReport.clientOrderId = order.clientOrderId;
-                executionReport.orderId = orderid;
+                executionReport.orderId = lastOrderId;
                 executionReport.instrument = order.instrument;
                 executionReport.price = order.price;
                 executionReport.quantity = order.quantity;
                 executionReport.status = 3;
 
-                output << executionReport.clientOrderId << ","
-                    << executionReport.orderId << ","
-                    << static_cast<int>(executionReport.instrument) << ","
-                    << executionReport.price << ","
-                    << executionReport.quantity << ","
-                    << executionReport.status <<  endl;
+                writeExecutionReport(executionReport, output);
             }
         }
 
@@ -222,7 +212,7 @@ public:
 int main() {
      auto start_time = std::chrono::high_resolution_clock::now();
      ifstream inputFile("orders.csv");
-     ofstream outputFile("report.csv");
+     ReportWriter outputFile("report.csv");
      string line;
 
     OrderBook orderBook;
@@ -243,6 +233,7 @@ int main() {
     }
 
     inputFile.close();
+    outputFile.flush();
     orderBook.printExecutionReport();
     auto end_time = std::chrono::high_resolution_clock::now();
     auto exec_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
@@ -1,381 +1,1160 @@
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <vector>
-#include <utility>
-#include <unordered_map>
-#include <queue>
-#include <chrono>
-#include <algorithm>
-#include <iomanip>
-
-using namespace std;
-
-int id = 0;
-
-enum class InstrumentType
-{
-    Rose,
-    Lavender,
-    Lotus,
-    Tulip,
-    Orchid,
-    Invalid
-};
-
-string instrumentToString(InstrumentType inst)
-{
-    switch (inst)
-    {
-    case InstrumentType::Rose:
-        return "Rose";
-    case InstrumentType::Lavender:
-        return "Lavender";
-    case InstrumentType::Lotus:
-        return "Lotus";
-    case InstrumentType::Tulip:
-        return "Tulip";
-    case InstrumentType::Orchid:
-        return "Orchid";
-    default:
-        return "Invalid";
-    }
-}
-
-string statusToString(int status)
-{
-    switch (status)
-    {
-    case 0:
-        return "New";
-    case 1:
-        return "Reject";
-    case 2:
-        return "Fill";
-    case 3:
-        return "PFill";
-    default:
-        return "Unknown";
-    }
-}
-
-struct Order
-{
-    string clientOrderId;
-    InstrumentType instrument;
-    int side;
-    double price;
-    int quantity;
-    int orderId;
-
-    void generateOrderId()
-    {
-        orderId = ++id;
-    }
-};
-
-struct ExecutionReport
-{
-    string clientOrderId;
-    int orderId;
-    InstrumentType instrument;
-    double price;
-    int quantity;
-    int status;
-    int side;
-    string reason;
-};
-
-void writeExecutionReport(const ExecutionReport &report, ofstream &output)
-{
-    output << report.clientOrderId << ","
-           << "ord" << report.orderId << ","
-           << instrumentToString(report.instrument) << ","
-           << report.side << ","
-           << statusToString(report.status) << ","
-           << report.quantity << ","
-           << fixed << setprecision(2) << report.price;
-    if (!report.reason.empty())
-    {
-        output << "," << report.reason;
-    }
-    output << endl;
-}
-
-struct BuySideComparator
-{
-    bool operator()(const Order &a, const Order &b)
-    {
-        if (a.price == b.price)
-            return a.orderId > b.orderId;
-        return a.price < b.price;
-    }
-};
-
-struct SellSideComparator
-{
-    bool operator()(const Order &a, const Order &b)
-    {
-        if (a.price == b.price)
-            return a.orderId > b.orderId;
-        return a.price > b.price;
-    }
-};
-
-class OrderBook
-{
-private:
-    unordered_map<InstrumentType, pair<priority_queue<Order, vector<Order>, BuySideComparator>,
-                                       priority_queue<Order, vector<Order>, SellSideComparator>>>
-        orderBooks;
-
-public:
-    void processOrder(Order &order, ofstream &output)
-    {
-        order.generateOrderId();
-
-        ExecutionReport executionReport;
-        executionReport.clientOrderId = order.clientOrderId;
-        executionReport.orderId = order.orderId;
-        executionReport.instrument = order.instrument;
-        executionReport.side = order.side;
-        executionReport.price = order.price;
-        executionReport.quantity = order.quantity;
-
-        if (order.clientOrderId.empty() || order.clientOrderId.length() > 7)
-        {
-            executionReport.status = 1;
-            executionReport.reason = "Invalid client order ID";
-            writeExecutionReport(executionReport, output);
-            return;
-        }
-        if (order.instrument == InstrumentType::Invalid)
-        {
-            executionReport.status = 1;
-            executionReport.reason = "Invalid instrument";
-            writeExecutionReport(executionReport, output);
-            return;
-        }
-        if (order.side != 1 && order.side != 2)
-        {
-            executionReport.status = 1;
-            executionReport.reason = "Invalid side";
-            writeExecutionReport(executionReport, output);
-            return;
-        }
-        if (order.price <= 0.0)
-        {
-            executionReport.status = 1;
-            executionReport.reason = "Invalid price";
-            writeExecutionReport(executionReport, output);
-            return;
-        }
-        if (order.quantity < 10 || order.quantity > 1000 || order.quantity % 10 != 0)
-        {
-            executionReport.status = 1;
-            executionReport.reason = "Invalid quantity";
-            writeExecutionReport(executionReport, output);
-            return;
-        }
-
-        pair<priority_queue<Order, vector<Order>, BuySideComparator>,
-             priority_queue<Order, vector<Order>, SellSideComparator>> &orderBook = orderBooks[order.instrument];
-
-        priority_queue<Order, vector<Order>, BuySideComparator> &buySide = orderBook.first;
-        priority_queue<Order, vector<Order>, SellSideComparator> &sellSide = orderBook.second;
-
-        int originalQuantity = order.quantity;
-        bool matched = false;
-
-        if (order.side == 1)
-        {
-            while (!sellSide.empty() && order.quantity > 0 && sellSide.top().price <= order.price)
-            {
-                matched = true;
-                Order sellOrder = sellSide.top();
-                sellSide.pop();
-
-                int matchedQuantity = min(order.quantity, sellOrder.quantity);
-                double matchPrice = sellOrder.price;
-
-                ExecutionReport buyReport;
-                buyReport.clientOrderId = order.clientOrderId;
-                buyReport.orderId = order.orderId;
-                buyReport.instrument = order.instrument;
-                buyReport.side = order.side;
-                buyReport.price = matchPrice;
-                buyReport.quantity = matchedQuantity;
-
-                ExecutionReport sellReport;
-                sellReport.clientOrderId = sellOrder.clientOrderId;
-                sellReport.orderId = sellOrder.orderId;
-                sellReport.instrument = sellOrder.instrument;
-                sellReport.side = sellOrder.side;
-                sellReport.price = matchPrice;
-                sellReport.quantity = matchedQuantity;
-
-                order.quantity -= matchedQuantity;
-                sellOrder.quantity -= matchedQuantity;
-
-                buyReport.status = (order.quantity == 0) ? 2 : 3;
-                sellReport.status = (sellOrder.quantity == 0) ? 2 : 3;
-
-                writeExecutionReport(buyReport, output);
-                writeExecutionReport(sellReport, output);
-
-                if (sellOrder.quantity > 0)
-                {
-                    sellSide.push(sellOrder);
-                }
-            }
-
-            if (order.quantity > 0)
-            {
-                if (!matched)
-                {
-                    executionReport.status = 0;
-                    executionReport.quantity = order.quantity;
-                    writeExecutionReport(executionReport, output);
-                }
-                buySide.push(order);
-            }
-        }
-        else
-        {
-            while (!buySide.empty() && order.quantity > 0 && buySide.top().price >= order.price)
-            {
-                matched = true;
-                Order buyOrder = buySide.top();
-                buySide.pop();
-
-                int matchedQuantity = min(order.quantity, buyOrder.quantity);
-                double matchPrice = buyOrder.price;
-
-                ExecutionReport sellReport;
-                sellReport.clientOrderId = order.clientOrderId;
-                sellReport.orderId = order.orderId;
-                sellReport.instrument = order.instrument;
-                sellReport.side = order.side;
-                sellReport.price = matchPrice;
-                sellReport.quantity = matchedQuantity;
-
-                ExecutionReport buyReport;
-                buyReport.clientOrderId = buyOrder.clientOrderId;
-                buyReport.orderId = buyOrder.orderId;
-                buyReport.instrument = buyOrder.instrument;
-                buyReport.side = buyOrder.side;
-                buyReport.price = matchPrice;
-                buyReport.quantity = matchedQuantity;
-
-                order.quantity -= matchedQuantity;
-                buyOrder.quantity -= matchedQuantity;
-
-                sellReport.status = (order.quantity == 0) ? 2 : 3;
-                buyReport.status = (buyOrder.quantity == 0) ? 2 : 3;
-
-                writeExecutionReport(buyReport, output);
-                writeExecutionReport(sellReport, output);
-
-                if (buyOrder.quantity > 0)
-                {
-                    buySide.push(buyOrder);
-                }
-            }
-
-            if (order.quantity > 0)
-            {
-                if (!matched)
-                {
-                    executionReport.status = 0;
-                    executionReport.quantity = order.quantity;
-                    writeExecutionReport(executionReport, output);
-                }
-                sellSide.push(order);
-            }
-        }
-    }
-};
-
-vector<string> splitString(const string &str, char d)
-{
-    vector<string> tokens;
-    stringstream ss(str);
-    string token;
-    while (getline(ss, token, d))
-    {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
-
-InstrumentType stringToInstrument(const string &ins)
-{
-    if (ins == "Rose")
-        return InstrumentType::Rose;
-    else if (ins == "Lavender")
-        return InstrumentType::Lavender;
-    else if (ins == "Lotus")
-        return InstrumentType::Lotus;
-    else if (ins == "Orchid")
-        return InstrumentType::Orchid;
-    else if (ins == "Tulip")
-        return InstrumentType::Tulip;
-    else
-        return InstrumentType::Invalid;
-}
-
-int main()
-{
-    auto start_time = chrono::high_resolution_clock::now();
-    ifstream inputFile("orders.csv");
-    ofstream outputFile("execution_rep.csv");
-    string line;
-
-    if (!inputFile.is_open())
-    {
-        cerr << "Error: Could not open orders.csv" << endl;
-        return 1;
-    }
-
-    outputFile << "Client Order ID,Order ID,Instrument,Side,Exec Status,Quantity,Price,Reason" << endl;
-
-    OrderBook orderBook;
-    getline(inputFile, line);
-
-    while (getline(inputFile, line))
-    {
-        if (line.empty())
-            continue;
-
-        vector<string> data = splitString(line, ',');
-
-        if (data.size() >= 5)
-        {
-            Order order;
-            order.clientOrderId = data[0];
-            order.instrument = stringToInstrument(data[1]);
-            
-            try
-            {
-                order.side = stoi(data[2]);
-                order.price = stod(data[3]);
-                order.quantity = stoi(data[4]);
-            }
-            catch (const exception &ex)
-            {
-                continue;
-            }
-
-            orderBook.processOrder(order, outputFile);
-        }
-    }
-
-    inputFile.close();
-    outputFile.close();
-
-    auto end_time = chrono::high_resolution_clock::now();
-    auto exec_time = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count();
-    cout << "Execution Time: " << exec_time << " Milliseconds" << endl;
-    return 0;
-}
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <filesystem>
+#include <new>
+
+#include "BatchValidator.h"
+#include "BinaryFormat.h"
+#include "Journal.h"
+#include "LatencyStats.h"
+#include "MarketData.h"
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderParser.h"
+#include "OrderServer.h"
+#include "ReportWriter.h"
+#include "SpscQueue.h"
+#include "ThreadPlacement.h"
+#include "TradeTape.h"
+
+using namespace std;
+
+#ifdef FLOWER_COUNT_ALLOCATIONS
+// Counts every heap allocation so a build with -DFLOWER_COUNT_ALLOCATIONS can
+// show that a serial run with --reserve at or above the peak number of resting
+// orders matches without allocating.
+atomic<size_t> heapAllocations{0};
+
+// Every replaceable form is replaced, so no allocation goes uncounted and
+// every delete frees what the matching new allocated. The nothrow forms
+// call these.
+void *countedAllocate(size_t size, size_t alignment)
+{
+    ++heapAllocations;
+    if (size == 0)
+        size = 1;
+    void *memory = alignment <= alignof(max_align_t)
+                       ? malloc(size)
+                       : aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (memory == nullptr)
+        throw bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size)
+{
+    return countedAllocate(size, 0);
+}
+
+void *operator new[](size_t size)
+{
+    return countedAllocate(size, 0);
+}
+
+void *operator new(size_t size, align_val_t alignment)
+{
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, align_val_t alignment)
+{
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t, align_val_t) noexcept
+{
+    free(memory);
+}
+#endif
+
+struct EngineOptions
+{
+    int shardCount = 0;
+    size_t reserveOrders = 0;
+    string journalPath;
+    string snapshotPath = "snapshot.bin";
+    size_t snapshotInterval = 0;
+    size_t journalFlushRecords = 1;
+    BlockValidatorFunction blockValidator = validateBlockScalar;
+    string marketDataPath;
+    int marketDepth = 5;
+    int selfTradePrevention = STP_NONE;
+    string positionsPath;
+    RiskLimits riskLimits;
+    string tradesPath;
+    int barInterval = 10000;
+    vector<AuctionWindow> auctions;
+    // CPUs of the ingest thread, the report writer and the shards, in that
+    // order; of the replay workers; or of the one thread of a serial run or
+    // the server.
+    ThreadPlacement placement;
+    int waitMode = WAIT_YIELD;
+    bool pipelineLatency = false;
+    long long ingestRate = 0;
+    // Order lookups to answer at the end of a serial run, in the form
+    // writeOrderQuery takes.
+    vector<string> queries;
+};
+
+// Pins the calling thread as thread number thread of --cpus, if it has a
+// CPU there.
+void placeThread(const EngineOptions &options, size_t thread, const char *role)
+{
+    int cpu = options.placement.cpuFor(thread);
+    if (cpu >= 0 && !pinThisThread(cpu))
+        cerr << "Warning: Could not pin the " << role << " to CPU " << cpu << endl;
+}
+
+string describeCpu(int cpu)
+{
+    if (cpu < 0)
+        return "any CPU";
+    int node = numaNodeOfCpu(cpu);
+    return "CPU " + to_string(cpu) + (node < 0 ? string() : " (node " + to_string(node) + ")");
+}
+
+typedef chrono::steady_clock PipelineClock;
+
+// An order's shard, for the merger, and when it arrived, for
+// --pipeline-latency.
+struct ShardRoute
+{
+    int shard = 0;
+    PipelineClock::time_point arrival;
+};
+
+// One report travelling from a matching shard to the merger. A record with
+// endOfOrder set closes the reports of the current order.
+struct ShardReport
+{
+    StoredReport stored;
+    bool endOfOrder = false;
+};
+
+// Report sink for OrderBook that hands reports to the merger instead of
+// formatting them.
+struct ShardOutput
+{
+    SpscQueue<ShardReport> &queue;
+    ShardReport record;
+};
+
+void writeExecutionReport(const ExecutionReport &report, ShardOutput &output)
+{
+    output.record.stored.store(report);
+    output.record.endOfOrder = false;
+    output.queue.push(output.record);
+}
+
+const size_t SHARD_QUEUE_CAPACITY = 1 << 16;
+
+struct MatchingShard
+{
+    SpscQueue<Order> orders{SHARD_QUEUE_CAPACITY};
+    SpscQueue<ShardReport> reports{SHARD_QUEUE_CAPACITY};
+};
+
+// Matches orders on several threads. This thread reads and numbers the
+// orders and routes each one to the shard that owns its instrument; every
+// shard matches its instruments on its own thread with its own OrderBook; a
+// merger thread writes the reports back out in input order, so the output is
+// byte-identical to a serial run.
+template <typename Source, typename Output>
+void processOrdersSharded(Source &orders, const EngineOptions &options, Output &output)
+{
+    int shardCount = options.shardCount;
+    vector<unique_ptr<MatchingShard>> shards;
+    for (int i = 0; i < shardCount; ++i)
+        shards.push_back(make_unique<MatchingShard>());
+    SpscQueue<ShardRoute> route(SHARD_QUEUE_CAPACITY);
+    route.setWaitMode(options.waitMode);
+    for (unique_ptr<MatchingShard> &shard : shards)
+    {
+        shard->orders.setWaitMode(options.waitMode);
+        shard->reports.setWaitMode(options.waitMode);
+    }
+    if (!options.placement.cpus.empty() || options.pipelineLatency)
+    {
+        cout << "Pipeline: ingest on " << describeCpu(options.placement.cpuFor(0)) << ", report writer on "
+             << describeCpu(options.placement.cpuFor(1));
+        for (int i = 0; i < shardCount; ++i)
+            cout << ", shard " << i + 1 << " on " << describeCpu(options.placement.cpuFor(2 + i));
+        cout << "; waiting: " << waitModeToString(options.waitMode) << endl;
+    }
+    placeThread(options, 0, "ingest thread");
+
+    // Shards build their books after pinning, so the books' memory is
+    // first touched, and so allocated, on the shard's own NUMA node.
+    vector<thread> workers;
+    for (int i = 0; i < shardCount; ++i)
+    {
+        workers.emplace_back([&options, i](MatchingShard *shard)
+                             {
+            placeThread(options, 2 + i, "shard");
+            OrderBook orderBook;
+            orderBook.reserve(options.reserveOrders);
+            orderBook.setSelfTradePrevention(options.selfTradePrevention);
+            orderBook.setRiskLimits(options.riskLimits);
+            ShardOutput shardOutput{shard->reports, ShardReport()};
+            Order order;
+            for (;;)
+            {
+                shard->orders.pop(order);
+                if (order.orderId == 0)
+                    break;
+                orderBook.processNumberedOrder(order, shardOutput);
+                shardOutput.record.endOfOrder = true;
+                shard->reports.push(shardOutput.record);
+            } },
+                             shards[i].get());
+    }
+
+    // The merger takes an order's latency once its last report is written.
+    vector<long long> latencies;
+    thread merger([&options, &shards, &route, &output, &latencies]()
+                  {
+        placeThread(options, 1, "report writer");
+        ShardRoute next;
+        ShardReport record;
+        for (;;)
+        {
+            route.pop(next);
+            if (next.shard < 0)
+                break;
+            for (;;)
+            {
+                shards[next.shard]->reports.pop(record);
+                if (record.endOfOrder)
+                    break;
+                writeExecutionReport(record.stored.get(), output);
+            }
+            if (options.pipelineLatency)
+                latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(PipelineClock::now() - next.arrival)
+                                        .count());
+        } });
+
+    // Orders are numbered here, in input order, so the shards' books never
+    // number them. With --ingest-rate each order arrives on a schedule and
+    // this thread spins until it is due.
+    bool stamp = options.pipelineLatency || options.ingestRate > 0;
+    PipelineClock::time_point start = PipelineClock::now();
+    int lastOrderId = 0;
+    Order order;
+    ShardRoute next;
+    while (orders.next(order))
+    {
+        order.orderId = ++lastOrderId;
+        next.shard = order.instrument == InstrumentType::Invalid ? 0 : static_cast<int>(order.instrument) % shardCount;
+        if (options.ingestRate > 0)
+        {
+            next.arrival = start + chrono::nanoseconds(static_cast<long long>(
+                                       static_cast<double>(lastOrderId - 1) * 1e9 / options.ingestRate));
+            while (PipelineClock::now() < next.arrival)
+                cpuRelax();
+        }
+        else if (stamp)
+        {
+            next.arrival = PipelineClock::now();
+        }
+        route.push(next);
+        shards[next.shard]->orders.push(order);
+    }
+
+    for (int i = 0; i < shardCount; ++i)
+    {
+        Order stop{};
+        shards[i]->orders.push(stop);
+    }
+    next.shard = -1;
+    route.push(next);
+
+    for (thread &worker : workers)
+        worker.join();
+    merger.join();
+
+    if (options.pipelineLatency)
+    {
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double fraction)
+        {
+            return latencies.empty() ? 0 : latencies[static_cast<size_t>(fraction * (latencies.size() - 1) + 0.5)];
+        };
+        cout << "Pipeline latency ns (" << waitModeToString(options.waitMode) << ", " << latencies.size()
+             << " orders): p50 " << percentile(0.5) << " p90 " << percentile(0.9) << " p99 " << percentile(0.99)
+             << " p99.9 " << percentile(0.999) << " max " << percentile(1.0) << endl;
+    }
+}
+
+// Market-data feed of a serial run, if --market-data was given: a depth
+// snapshot when it starts, incremental updates after every order and another
+// snapshot at the end.
+struct MarketDataFeed
+{
+    unique_ptr<ReportWriter> file;
+    unique_ptr<MarketDataPublisher> publisher;
+    int depth = 0;
+
+    bool open(const EngineOptions &options, OrderBook &orderBook)
+    {
+        if (options.marketDataPath.empty())
+            return true;
+        file = make_unique<ReportWriter>(options.marketDataPath.c_str());
+        if (!file->is_open())
+        {
+            cerr << "Error: Could not open " << options.marketDataPath << endl;
+            return false;
+        }
+        publisher = make_unique<MarketDataPublisher>(orderBook, *file);
+        depth = options.marketDepth;
+        publisher->writeDepthSnapshot(depth);
+        return true;
+    }
+
+    void publish()
+    {
+        if (publisher)
+            publisher->publish();
+    }
+
+    ~MarketDataFeed()
+    {
+        if (publisher)
+            publisher->writeDepthSnapshot(depth);
+    }
+};
+
+// Trade tape and statistics of a serial run, if --trades was given: a line
+// per trade as it happens, bars as they close and the session totals at the
+// end.
+struct TradeFeed
+{
+    unique_ptr<ReportWriter> file;
+    unique_ptr<TradeRecorder> recorder;
+
+    bool open(const EngineOptions &options, OrderBook &orderBook)
+    {
+        if (options.tradesPath.empty())
+            return true;
+        file = make_unique<ReportWriter>(options.tradesPath.c_str());
+        if (!file->is_open())
+        {
+            cerr << "Error: Could not open " << options.tradesPath << endl;
+            return false;
+        }
+        recorder = make_unique<TradeRecorder>(orderBook, *file, options.barInterval);
+        return true;
+    }
+
+    void publish(int orderId)
+    {
+        if (recorder)
+            recorder->publish(orderId);
+    }
+
+    ~TradeFeed()
+    {
+        if (recorder)
+            recorder->finish();
+    }
+};
+
+// Writes every account's position in every instrument at the end of a serial
+// run, if --positions was given.
+bool writePositions(const EngineOptions &options, const OrderBook &orderBook)
+{
+    if (options.positionsPath.empty())
+        return true;
+    ReportWriter output(options.positionsPath.c_str());
+    if (!output.is_open())
+    {
+        cerr << "Error: Could not open " << options.positionsPath << endl;
+        return false;
+    }
+    output.append("Account,Instrument,Position,Notional").endRecord();
+    const AccountTable &accounts = orderBook.accountTable();
+    accounts.forEachPosition([&](int account, InstrumentType instrument, const Position &position)
+                             {
+        output.append(accounts.name(account)).append(',')
+            .append(instrumentToString(instrument)).append(',')
+            .appendInt(position.quantity).append(',')
+            .appendFixed(position.notional, PRICE_DECIMALS);
+        output.endRecord(); });
+    return true;
+}
+
+// Prints the state of the orders looked up with --query-order-id and
+// --query-client-id at the end of a serial run.
+void answerQueries(const EngineOptions &options, const OrderBook &orderBook)
+{
+    if (options.queries.empty())
+        return;
+    string answers;
+    {
+        ReportWriter output(answers);
+        for (const string &query : options.queries)
+            writeOrderQuery(orderBook, query, output);
+    }
+    cout << answers;
+}
+
+// Serial run that restores the books from the snapshot and journal first,
+// journals every order before matching it, checkpoints every
+// snapshotInterval orders and once more at the end.
+template <typename Source, typename Output>
+bool processOrdersJournaled(Source &orders, const EngineOptions &options, OrderBook &orderBook, Output &output)
+{
+    Journal journal(options.journalPath, options.snapshotPath, options.journalFlushRecords);
+    RestoreStats stats;
+    if (!journal.restore(orderBook, stats))
+    {
+        cerr << "Error: Could not restore from " << options.snapshotPath << " and " << options.journalPath << endl;
+        return false;
+    }
+    cout << "Restored " << stats.snapshotOrders << " resting orders from the snapshot and replayed "
+         << stats.journalOrders << " journaled orders" << endl;
+    // A crash can cut off the fills of the last journaled order, but replay
+    // should never produce fewer fills than were journaled.
+    if (stats.replayedFills < stats.journalFills)
+        cerr << "Warning: Replay produced " << stats.replayedFills << " fills, the journal has " << stats.journalFills << endl;
+
+    // Folds the journal tail into a fresh snapshot, so the next restart only
+    // reads what this run adds.
+    if (!journal.checkpoint(orderBook))
+    {
+        cerr << "Error: Could not write " << options.snapshotPath << endl;
+        return false;
+    }
+
+    MarketDataFeed marketData;
+    TradeFeed trades;
+    if (!marketData.open(options, orderBook) || !trades.open(options, orderBook))
+        return false;
+
+    JournaledOutput<Output> journaled{journal, output};
+    size_t sinceCheckpoint = 0;
+    Order order;
+    while (orders.next(order))
+    {
+        order.orderId = orderBook.nextOrderId();
+        journal.recordOrder(order, orderBook.validateOrder(order));
+        orderBook.processNumberedOrder(order, journaled);
+        marketData.publish();
+        trades.publish(order.orderId);
+        if (options.snapshotInterval != 0 && ++sinceCheckpoint == options.snapshotInterval)
+        {
+            sinceCheckpoint = 0;
+            if (!journal.checkpoint(orderBook))
+                cerr << "Warning: Could not write " << options.snapshotPath << endl;
+        }
+    }
+    orderBook.uncross(journaled);
+    marketData.publish();
+    trades.publish(orderBook.lastAssignedOrderId());
+
+    if (!journal.checkpoint(orderBook))
+    {
+        cerr << "Error: Could not write " << options.snapshotPath << endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename Source, typename Output>
+bool processOrders(Source &orders, const EngineOptions &options, Output &output)
+{
+    if (options.shardCount > 0)
+    {
+        processOrdersSharded(orders, options, output);
+        return true;
+    }
+
+    OrderBook orderBook;
+    orderBook.reserve(options.reserveOrders);
+    orderBook.setSelfTradePrevention(options.selfTradePrevention);
+    orderBook.setRiskLimits(options.riskLimits);
+    for (const AuctionWindow &window : options.auctions)
+        orderBook.scheduleAuction(window.firstOrderId, window.lastOrderId);
+    if (!options.queries.empty())
+        orderBook.indexClientOrderIds();
+    if (!options.journalPath.empty())
+    {
+        if (!processOrdersJournaled(orders, options, orderBook, output))
+            return false;
+        answerQueries(options, orderBook);
+        return writePositions(options, orderBook);
+    }
+    MarketDataFeed marketData;
+    TradeFeed trades;
+    if (!marketData.open(options, orderBook) || !trades.open(options, orderBook))
+        return false;
+#ifdef FLOWER_COUNT_ALLOCATIONS
+    size_t allocationsBefore = heapAllocations;
+#endif
+
+    // Orders are read and validated a block at a time; rejects go straight
+    // to their report without entering the matching path.
+    BatchValidator validator(options.blockValidator);
+    ValidationBlock block;
+    ValidationResult result;
+    Order batch[VALIDATION_BLOCK_SIZE];
+    bool more = true;
+    while (more)
+    {
+        block.clear();
+        while (!block.full() && (more = orders.next(batch[block.count])))
+            block.add(batch[block.count]);
+        validator.run(block, result);
+        for (size_t i = 0; i < block.count; ++i)
+        {
+            batch[i].orderId = orderBook.nextOrderId();
+            orderBook.processValidatedOrder(batch[i], result.reasons[i], output);
+            marketData.publish();
+            trades.publish(batch[i].orderId);
+        }
+    }
+    // An auction still collecting orders closes with the input.
+    orderBook.uncross(output);
+    marketData.publish();
+    trades.publish(orderBook.lastAssignedOrderId());
+
+#ifdef FLOWER_COUNT_ALLOCATIONS
+    cout << "Heap allocations while matching: " << heapAllocations - allocationsBefore << endl;
+#endif
+    answerQueries(options, orderBook);
+    return writePositions(options, orderBook);
+}
+
+template <typename Source>
+bool processOrders(Source &orders, const EngineOptions &options, ReportWriter &output, bool binaryOutput)
+{
+    if (binaryOutput)
+    {
+        BinaryReportWriter binaryReports(output);
+        return processOrders(orders, options, binaryReports);
+    }
+
+    output.append("Client Order ID,Order ID,Instrument,Side,Exec Status,Quantity,Price,Reason").endRecord();
+    return processOrders(orders, options, output);
+}
+
+// Hands out the orders of another source and counts them.
+template <typename Source>
+struct CountingSource
+{
+    Source &orders;
+    size_t count = 0;
+
+    bool next(Order &order)
+    {
+        if (!orders.next(order))
+            return false;
+        ++count;
+        return true;
+    }
+};
+
+// Matches one mapped CSV or binary order file into output on its own book and
+// order ID sequence.
+bool processOrderFile(const MappedFile &inputFile, const string &inputPath, const EngineOptions &options,
+                      ReportWriter &output, bool binaryOutput, size_t &orderCount)
+{
+    if (hasBinaryMagic(inputFile.contents(), ORDER_FILE_MAGIC))
+    {
+        BinaryOrderReader orders;
+        if (!orders.open(inputFile.contents()))
+        {
+            cerr << "Error: Unsupported binary order file " << inputPath << endl;
+            return false;
+        }
+        CountingSource<BinaryOrderReader> counted{orders};
+        bool processed = processOrders(counted, options, output, binaryOutput);
+        orderCount = counted.count;
+        return processed;
+    }
+
+    CsvOrderReader orders(inputFile.contents());
+    CountingSource<CsvOrderReader> counted{orders};
+    bool processed = processOrders(counted, options, output, binaryOutput);
+    orderCount = counted.count;
+    return processed;
+}
+
+struct ReplayFile
+{
+    string inputPath;
+    string outputPath;
+    size_t orders = 0;
+    size_t reports = 0;
+    double milliseconds = 0;
+    bool replayed = false;
+};
+
+bool isExecutionReport(const filesystem::path &path)
+{
+    string stem = path.stem().string();
+    const string suffix = "_execution_rep";
+    return stem.size() >= suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Expands the replay arguments into files: a directory stands for its .csv
+// and .bin files in name order, leaving out earlier execution reports. Each
+// file's reports go to <output directory>/<stem>_execution_rep.csv (or .bin).
+bool listReplayFiles(const vector<string> &paths, const string &outputDirectory, bool binaryOutput,
+                     vector<ReplayFile> &files)
+{
+    for (const string &path : paths)
+    {
+        error_code error;
+        vector<filesystem::path> inputs;
+        if (filesystem::is_directory(path, error))
+        {
+            for (const filesystem::directory_entry &entry : filesystem::directory_iterator(path, error))
+            {
+                string extension = entry.path().extension().string();
+                if (entry.is_regular_file(error) && (extension == ".csv" || extension == ".bin") &&
+                    !isExecutionReport(entry.path()))
+                    inputs.push_back(entry.path());
+            }
+            sort(inputs.begin(), inputs.end());
+        }
+        else
+        {
+            inputs.push_back(path);
+        }
+        if (error)
+        {
+            cerr << "Error: Could not list " << path << endl;
+            return false;
+        }
+
+        for (const filesystem::path &input : inputs)
+        {
+            ReplayFile file;
+            file.inputPath = input.string();
+            file.outputPath = (filesystem::path(outputDirectory) /
+                               (input.stem().string() + (binaryOutput ? "_execution_rep.bin" : "_execution_rep.csv")))
+                                  .string();
+            for (const ReplayFile &other : files)
+            {
+                if (other.outputPath == file.outputPath)
+                {
+                    cerr << "Error: " << other.inputPath << " and " << file.inputPath << " would both write "
+                         << file.outputPath << endl;
+                    return false;
+                }
+            }
+            files.push_back(file);
+        }
+    }
+    return true;
+}
+
+// Replays many order files at once, e.g. one per trading day. Worker threads
+// take the next file in turn and match it from scratch, each file on its own
+// OrderBook with its own order ID sequence, so every report file is identical
+// to a single run of that file. Prints one line per file in argument order
+// and the aggregate throughput.
+int replayFiles(vector<ReplayFile> &files, const EngineOptions &options, int threadCount, size_t flushBytes,
+                size_t flushRecords, bool binaryOutput)
+{
+    auto start = chrono::steady_clock::now();
+    atomic<size_t> nextFile{0};
+    auto replay = [&](int worker)
+    {
+        placeThread(options, static_cast<size_t>(worker), "replay worker");
+        for (size_t index = nextFile++; index < files.size(); index = nextFile++)
+        {
+            ReplayFile &file = files[index];
+            auto fileStart = chrono::steady_clock::now();
+            MappedFile inputFile;
+            if (!inputFile.open(file.inputPath.c_str()))
+            {
+                cerr << "Error: Could not open " << file.inputPath << endl;
+                continue;
+            }
+            ReportWriter output(file.outputPath.c_str(), flushBytes, flushRecords);
+            if (!output.is_open())
+            {
+                cerr << "Error: Could not open " << file.outputPath << endl;
+                continue;
+            }
+            file.replayed = processOrderFile(inputFile, file.inputPath, options, output, binaryOutput, file.orders);
+            output.close();
+            file.reports = output.records() - (binaryOutput || output.records() == 0 ? 0 : 1);
+            file.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - fileStart).count();
+        }
+    };
+
+    threadCount = max(1, min(threadCount, static_cast<int>(files.size())));
+    vector<thread> workers;
+    for (int i = 1; i < threadCount; ++i)
+        workers.emplace_back(replay, i);
+    replay(0);
+    for (thread &worker : workers)
+        worker.join();
+    double wallMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    size_t orders = 0;
+    size_t reports = 0;
+    double busyMilliseconds = 0;
+    size_t failed = 0;
+    for (const ReplayFile &file : files)
+    {
+        if (!file.replayed)
+        {
+            ++failed;
+            continue;
+        }
+        orders += file.orders;
+        reports += file.reports;
+        busyMilliseconds += file.milliseconds;
+        cout << file.inputPath << ": " << file.orders << " orders, " << file.reports << " reports in "
+             << static_cast<long long>(file.milliseconds) << " ms -> " << file.outputPath << endl;
+    }
+    double seconds = wallMilliseconds / 1000;
+    cout << "Replayed " << files.size() - failed << " of " << files.size() << " files on " << threadCount
+         << " threads: " << orders << " orders, " << reports << " reports in "
+         << static_cast<long long>(wallMilliseconds) << " ms" << endl;
+    cout << "Throughput: " << static_cast<long long>(seconds > 0 ? orders / seconds : 0) << " orders/s, "
+         << static_cast<long long>(seconds > 0 ? reports / seconds : 0) << " reports/s, files took "
+         << static_cast<long long>(busyMilliseconds) << " ms one after another" << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    auto start_time = chrono::high_resolution_clock::now();
+
+    EngineOptions options;
+    options.blockValidator = selectBlockValidator();
+    PriceBand priceBand;
+    bool priceBandSet = false;
+    string instrumentsPath;
+    size_t flushBytes = ReportWriter::DEFAULT_BUFFER_SIZE;
+    size_t flushRecords = 0;
+    string inputPath = "orders.csv";
+    string outputPath = "execution_rep.csv";
+    bool binaryOutput = false;
+    ServerOptions serverOptions;
+    bool serverMode = false;
+    // Any of --snapshot, --snapshot-every and --journal-flush.
+    bool snapshotOptionSet = false;
+    vector<string> replayPaths;
+    string replayOutput = ".";
+    int replayThreads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--input" && i + 1 < argc)
+        {
+            inputPath = argv[++i];
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            while (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+                replayPaths.push_back(argv[++i]);
+        }
+        else if (arg == "--replay-output" && i + 1 < argc)
+        {
+            replayOutput = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            replayThreads = max(atoi(argv[++i]), 1);
+        }
+        else if (arg == "--binary-output")
+        {
+            binaryOutput = true;
+        }
+        else if (arg == "--shards" && i + 1 < argc)
+        {
+            options.shardCount = max(atoi(argv[++i]), 0);
+        }
+        else if (arg == "--reserve" && i + 1 < argc)
+        {
+            options.reserveOrders = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--listen-tcp" && i + 1 < argc)
+        {
+            serverOptions.tcpPort = max(atoi(argv[++i]), 0);
+            serverMode = true;
+        }
+        else if (arg == "--listen-unix" && i + 1 < argc)
+        {
+            serverOptions.unixPath = argv[++i];
+            serverMode = true;
+        }
+        else if (arg == "--listen-stdin")
+        {
+            serverOptions.useStdin = true;
+            serverMode = true;
+        }
+        else if (arg == "--validator" && i + 1 < argc)
+        {
+            options.blockValidator = selectBlockValidator(argv[++i]);
+            if (options.blockValidator == nullptr)
+            {
+                cerr << "Error: Validator " << argv[i] << " is not available" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--market-data" && i + 1 < argc)
+        {
+            options.marketDataPath = argv[++i];
+        }
+        else if (arg == "--market-depth" && i + 1 < argc)
+        {
+            options.marketDepth = max(atoi(argv[++i]), 0);
+        }
+        else if (arg == "--journal" && i + 1 < argc)
+        {
+            options.journalPath = argv[++i];
+        }
+        else if (arg == "--snapshot" && i + 1 < argc)
+        {
+            options.snapshotPath = argv[++i];
+            snapshotOptionSet = true;
+        }
+        else if (arg == "--snapshot-every" && i + 1 < argc)
+        {
+            options.snapshotInterval = strtoull(argv[++i], nullptr, 10);
+            snapshotOptionSet = true;
+        }
+        else if (arg == "--journal-flush" && i + 1 < argc)
+        {
+            options.journalFlushRecords = strtoull(argv[++i], nullptr, 10);
+            snapshotOptionSet = true;
+        }
+        else if (arg == "--flush-bytes" && i + 1 < argc)
+        {
+            flushBytes = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--flush-records" && i + 1 < argc)
+        {
+            flushRecords = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--price-band" && i + 2 < argc)
+        {
+            long long minTick = 0;
+            if (!parsePrice(argv[++i], minTick) || !parsePrice(argv[++i], priceBand.maxTick))
+            {
+                cerr << "Error: Invalid price band" << endl;
+                return 1;
+            }
+            priceBand.minTick = max(1LL, minTick);
+            priceBandSet = true;
+        }
+        else if (arg == "--stp" && i + 1 < argc)
+        {
+            options.selfTradePrevention = stringToSelfTradePrevention(argv[++i]);
+            if (options.selfTradePrevention == STP_MODE_COUNT)
+            {
+                cerr << "Error: Unknown self-trade prevention mode " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--price-collar" && i + 1 < argc)
+        {
+            options.riskLimits.collarBasisPoints = max(atoll(argv[++i]), 0LL);
+        }
+        else if (arg == "--max-notional" && i + 1 < argc)
+        {
+            if (!parsePrice(argv[++i], options.riskLimits.maxNotional) || options.riskLimits.maxNotional < 0)
+            {
+                cerr << "Error: Invalid notional limit" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--max-open-quantity" && i + 1 < argc)
+        {
+            options.riskLimits.maxOpenQuantity = max(atoll(argv[++i]), 0LL);
+        }
+        else if (arg == "--order-rate" && i + 2 < argc)
+        {
+            options.riskLimits.maxOrders = max(atoi(argv[++i]), 0);
+            options.riskLimits.rateWindow = max(atoi(argv[++i]), 0);
+        }
+        else if (arg == "--trades" && i + 1 < argc)
+        {
+            options.tradesPath = argv[++i];
+        }
+        else if (arg == "--bar-interval" && i + 1 < argc)
+        {
+            options.barInterval = max(atoi(argv[++i]), 0);
+        }
+        else if (arg == "--positions" && i + 1 < argc)
+        {
+            options.positionsPath = argv[++i];
+        }
+        else if (arg == "--auction" && i + 2 < argc)
+        {
+            AuctionWindow window{atoi(argv[i + 1]), atoi(argv[i + 2])};
+            i += 2;
+            int previousLast = options.auctions.empty() ? 0 : options.auctions.back().lastOrderId;
+            if (window.firstOrderId <= 0 || window.lastOrderId < 0 ||
+                (window.lastOrderId != 0 && window.lastOrderId < window.firstOrderId) ||
+                (!options.auctions.empty() && (previousLast == 0 || window.firstOrderId <= previousLast)))
+            {
+                cerr << "Error: Invalid auction window " << argv[i - 1] << " " << argv[i] << endl;
+                return 1;
+            }
+            options.auctions.push_back(window);
+        }
+        else if (arg == "--cpus" && i + 1 < argc)
+        {
+            if (!parseCpuList(argv[++i], options.placement.cpus))
+            {
+                cerr << "Error: Invalid CPU list " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--wait" && i + 1 < argc)
+        {
+            options.waitMode = stringToWaitMode(argv[++i]);
+            if (options.waitMode == WAIT_MODE_COUNT)
+            {
+                cerr << "Error: Unknown wait mode " << argv[i] << endl;
+                return 1;
+            }
+            serverOptions.waitMode = options.waitMode;
+        }
+        else if (arg == "--pipeline-latency")
+        {
+            options.pipelineLatency = true;
+        }
+        else if (arg == "--ingest-rate" && i + 1 < argc)
+        {
+            options.ingestRate = max(atoll(argv[++i]), 0LL);
+        }
+        else if (arg == "--query-order-id" && i + 1 < argc)
+        {
+            options.queries.push_back(string("#") + argv[++i]);
+        }
+        else if (arg == "--query-client-id" && i + 1 < argc)
+        {
+            options.queries.push_back(string("@") + argv[++i]);
+        }
+        else if (arg == "--instruments" && i + 1 < argc)
+        {
+            instrumentsPath = argv[++i];
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--input FILE] [--output FILE] [--binary-output] [--instruments FILE] [--price-band MIN MAX]"
+                 << " [--shards N] [--reserve N] [--flush-bytes N] [--flush-records N]"
+                 << " [--journal FILE] [--snapshot FILE] [--snapshot-every N] [--journal-flush N]"
+                 << " [--listen-tcp PORT] [--listen-unix PATH] [--listen-stdin] [--validator auto|avx2|sse4.2|scalar]"
+                 << " [--market-data FILE] [--market-depth N] [--trades FILE] [--bar-interval N]"
+                 << " [--stp none|cancel-newest|cancel-oldest|decrement-both] [--positions FILE]"
+                 << " [--price-collar BPS] [--max-notional VALUE] [--max-open-quantity N] [--order-rate N WINDOW]"
+                 << " [--auction FIRST LAST]... [--cpus LIST] [--wait block|yield|spin] [--pipeline-latency]"
+                 << " [--ingest-rate N] [--query-order-id ID]... [--query-client-id ID]..."
+                 << " [--replay PATH...] [--replay-output DIR] [--threads N]" << endl;
+            return 1;
+        }
+    }
+    // The server neither journals nor snapshots its book, so it must not
+    // look as if it did.
+    if ((!options.journalPath.empty() || snapshotOptionSet) && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --journal and --snapshot need a serial run" << endl;
+        return 1;
+    }
+    if (snapshotOptionSet && options.journalPath.empty())
+    {
+        cerr << "Error: --snapshot, --snapshot-every and --journal-flush need --journal" << endl;
+        return 1;
+    }
+    if (!options.marketDataPath.empty() && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --market-data needs a serial run" << endl;
+        return 1;
+    }
+    if (!options.tradesPath.empty() && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --trades needs a serial run" << endl;
+        return 1;
+    }
+    if (!options.positionsPath.empty() && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --positions needs a serial run" << endl;
+        return 1;
+    }
+    // A server answers lookups sent to it instead (see OrderServer).
+    if (!options.queries.empty() && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --query-order-id and --query-client-id need a serial run" << endl;
+        return 1;
+    }
+    // An account's orders can be on every shard, so its limits would only
+    // see part of them.
+    if (options.riskLimits.perAccount() && options.shardCount > 0)
+    {
+        cerr << "Error: --max-open-quantity and --order-rate need a run without shards" << endl;
+        return 1;
+    }
+    if ((options.pipelineLatency || options.ingestRate > 0) && options.shardCount == 0)
+    {
+        cerr << "Error: --pipeline-latency and --ingest-rate need --shards" << endl;
+        return 1;
+    }
+    // Every shard would uncross on its own when its next order arrives, not
+    // all at once, and a server has no end of input.
+    if (!options.auctions.empty() && (options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --auction needs a serial run" << endl;
+        return 1;
+    }
+    if (!replayPaths.empty() && (!options.journalPath.empty() || !options.marketDataPath.empty() ||
+                                 !options.tradesPath.empty() || !options.positionsPath.empty() ||
+                                 !options.queries.empty() || options.shardCount > 0 || serverMode))
+    {
+        cerr << "Error: --replay runs each file serially, without shards, journal, market data, trades, positions,"
+             << " queries or server mode" << endl;
+        return 1;
+    }
+    if (priceBand.maxTick < priceBand.minTick)
+    {
+        cerr << "Error: Invalid price band" << endl;
+        return 1;
+    }
+
+    // The universe has to be in place before any book is created.
+    if (!instrumentsPath.empty())
+    {
+        InstrumentUniverse universe;
+        size_t errorLine = 0;
+        if (!loadInstrumentUniverse(instrumentsPath.c_str(), universe, errorLine))
+        {
+            cerr << "Error: Invalid instrument file " << instrumentsPath;
+            if (errorLine != 0)
+                cerr << " at line " << errorLine;
+            cerr << endl;
+            return 1;
+        }
+        instrumentUniverse() = move(universe);
+    }
+    if (priceBandSet)
+        instrumentUniverse().setPriceBand(priceBand);
+    options.shardCount = min(options.shardCount, instrumentCount());
+
+    if (!replayPaths.empty())
+    {
+        vector<ReplayFile> files;
+        if (!listReplayFiles(replayPaths, replayOutput, binaryOutput, files))
+            return 1;
+        if (files.empty())
+        {
+            cerr << "Error: No order files to replay" << endl;
+            return 1;
+        }
+        return replayFiles(files, options, replayThreads, flushBytes, flushRecords, binaryOutput);
+    }
+
+    if (serverMode)
+    {
+#ifdef FLOWER_HAVE_EPOLL
+        placeThread(options, 0, "server thread");
+        {
+            OrderBook orderBook;
+            orderBook.reserve(options.reserveOrders);
+            orderBook.setSelfTradePrevention(options.selfTradePrevention);
+            orderBook.setRiskLimits(options.riskLimits);
+            OrderServer server(orderBook, serverOptions);
+            if (!server.open())
+                return 1;
+            server.run();
+        }
+#ifdef FLOWER_LATENCY_STATS
+        // The book hands its histograms over when it goes, and stdout may
+        // carry reports, so the summary follows the server's own on stderr.
+        printLatencyStats(cerr);
+#endif
+        return 0;
+#else
+        cerr << "Error: Server mode needs Linux" << endl;
+        return 1;
+#endif
+    }
+
+    MappedFile inputFile;
+    if (!inputFile.open(inputPath.c_str()))
+    {
+        cerr << "Error: Could not open " << inputPath << endl;
+        return 1;
+    }
+
+    ReportWriter outputFile(outputPath.c_str(), flushBytes, flushRecords);
+    if (!outputFile.is_open())
+    {
+        cerr << "Error: Could not open " << outputPath << endl;
+        return 1;
+    }
+
+    // A serial run has one thread; the pipeline places its own.
+    if (options.shardCount == 0)
+        placeThread(options, 0, "matching thread");
+    size_t orderCount = 0;
+    if (!processOrderFile(inputFile, inputPath, options, outputFile, binaryOutput, orderCount))
+        return 1;
+
+    outputFile.close();
+
+    auto end_time = chrono::high_resolution_clock::now();
+    auto exec_time = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count();
+    cout << "Execution Time: " << exec_time << " Milliseconds" << endl;
+#ifdef FLOWER_LATENCY_STATS
+    printLatencyStats(cout);
+#endif
+    return 0;
+}